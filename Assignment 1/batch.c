@@ -0,0 +1,102 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "batch.h"
+#include "jobs.h"
+#include "pipeline.h"
+
+#define BATCH_MAX_PENDING 256 //commands whose output we keep at once (every one holds an fd until it is printed).
+
+typedef struct {
+    unsigned long serial; //job of the command, 0 if it started nothing (the output is only errors).
+    int fd; //memory file with the output.
+} batch_entry;
+
+static batch_entry *entries = NULL; //commands in script order, from head the ones we didn't print yet.
+static int head = 0;
+static int tail = 0;
+static int capacity = 0;
+static int stdoutCopy = -1; //the real stdout, while fd 1 and 2 point to the output of a command.
+
+void batch_init(void) {
+    stdoutCopy = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    if (stdoutCopy < 0) {
+        perror("error");
+        exit(1);
+    }
+}
+
+static void push_entry(unsigned long serial, int fd) {
+    if (tail == capacity) {
+        capacity = capacity ? capacity * 2 : 64;
+        entries = realloc(entries, capacity * sizeof(batch_entry));
+        if (!entries) {
+            perror("error");
+            exit(1);
+        }
+    }
+    entries[tail].serial = serial;
+    entries[tail].fd = fd;
+    tail++;
+}
+
+static bool print_head(bool wait) {
+    //Prints the output of the first command we didn't print yet, if it is done (or after waiting for it).
+    batch_entry *entry = &entries[head];
+    if (entry->serial && !jobs_done(entry->serial, wait)) {
+        return false;
+    }
+    lseek(entry->fd, 0, SEEK_SET);
+    if (copy_fd(entry->fd, STDOUT_FILENO) < 0) {
+        perror("error");
+    }
+    close(entry->fd);
+    head++;
+    if (head == tail) {
+        head = 0;
+        tail = 0;
+    }
+    return true;
+}
+
+void batch_run(command_line *line, const char *command, bool timed, int strategy) {
+    //One slow command holds back the output of everything after it, so at some point we wait for it.
+    while (tail - head >= BATCH_MAX_PENDING) {
+        print_head(true);
+    }
+    int fd = memfd_create("myshell-output", MFD_CLOEXEC);
+    if (fd < 0) {
+        perror("error");
+        exit(1);
+    }
+    //The children get fd 1 and 2 as they are when we start them, so for the time we start the command
+    //they are the memory file - and so are the errors we print about it ourselves.
+    fflush(stdout);
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+
+    unsigned long serial = 0;
+    int count = parse_pipeline(line->words, line->operators, line->stages);
+    if (count > 0) {
+        job *job = jobs_start(command, line->stages[0].argv[0], count, true); //waits until a worker is free.
+        job->timed = timed;
+        run_pipeline(line->stages, count, strategy, job);
+        serial = job->serial;
+        jobs_started(job);
+    }
+
+    fflush(stdout);
+    dup2(stdoutCopy, STDOUT_FILENO);
+    dup2(stdoutCopy, STDERR_FILENO);
+    push_entry(serial, fd);
+    batch_flush(false);
+}
+
+void batch_flush(bool wait) {
+    fflush(stdout); //a builtin may have printed before us.
+    while (head < tail && print_head(wait)) {
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <stdbool.h>
+#include "tokenizer.h"
+
+//"myshell -j N script" - the commands of the script run on up to N workers at once (no prompts).
+//The output of every command (and the errors about it) goes to a memory file of its own, and is printed
+//in the order of the script once the command and all the commands before it are done.
+//Builtins (and "wait", as an explicit barrier) run only after everything before them is done.
+
+void batch_init(void);
+
+/**
+ * Starts the command line (a pipeline, not a builtin) without waiting for it.
+ * @param command - the line as it was written, for the job table.
+ * @param timed - "time" before it, see stats.h.
+ */
+void batch_run(command_line *line, const char *command, bool timed, int strategy);
+
+/**
+ * Prints the output of the commands that are done, in order.
+ * @param wait - waits for all of them (a barrier).
+ */
+void batch_flush(bool wait);
+
+#endif
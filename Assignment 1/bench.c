@@ -0,0 +1,366 @@
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+//Benchmark of myshell (see "make bench"). The shell runs on a pseudo terminal, as it does for a user, so it
+//prints its prompt and flushes it - a line is timed from writing it to the shell until the next prompt is read.
+//Every case runs a few times to warm up, and then -n times, and we print the min, the median and the 90th
+//percentile in microseconds. The startup cases time from fork to the first prompt, the history cases run with
+//a history file of HISTORY_LINES lines (history.h keeps the last 10000 of them), "history_add" pipes
+//HISTORY_LINES commands into the shell (so every add drops the oldest entry) and prints the time per line.
+//-o file writes the medians, -c file compares the medians to such a file and fails if one of them is more
+//than -T (default 25%) slower - a regression gate: "./bench -o base.txt" before a change, "./bench -c base.txt"
+//after it.
+
+#define PROMPT "my-shell> "
+#define PROMPT_LENGTH (sizeof(PROMPT) - 1)
+#define DEFAULT_RUNS 200
+#define WARMUP 20
+#define HISTORY_LINES 100000
+#define DEFAULT_TOLERANCE 0.25
+#define MAX_CASES 32
+
+typedef struct {
+    int fd; //the master side of the terminal of the shell.
+    pid_t pid;
+} shell;
+
+typedef struct {
+    char name[32];
+    int runs;
+    double min; //microseconds
+    double median;
+    double p90;
+} result;
+
+static const char *shellPath = "./myshell";
+static const char *strategy = NULL;
+static result results[MAX_CASES];
+static int resultCount = 0;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fail(const char *what) {
+    perror(what);
+    exit(1);
+}
+
+static void shell_argv(char *argv[], const char *historyFile) {
+    int argc = 0;
+    argv[argc++] = (char *) shellPath;
+    if (strategy) {
+        argv[argc++] = "-s";
+        argv[argc++] = (char *) strategy;
+    }
+    if (historyFile) {
+        argv[argc++] = "-H";
+        argv[argc++] = (char *) historyFile;
+    }
+    argv[argc] = NULL;
+}
+
+static void wait_prompt(shell *shell) {
+    //Reads everything the shell prints until it ends with the prompt (we only keep the last bytes of it).
+    static char buffer[1 << 16];
+    char tail[PROMPT_LENGTH];
+    size_t tailLength = 0;
+    while (1) {
+        ssize_t length = read(shell->fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            fprintf(stderr, "error: %s exited\n", shellPath);
+            exit(1);
+        }
+        if ((size_t) length >= PROMPT_LENGTH) {
+            memcpy(tail, buffer + length - PROMPT_LENGTH, PROMPT_LENGTH);
+            tailLength = PROMPT_LENGTH;
+        } else {
+            size_t keep = tailLength + length > PROMPT_LENGTH ? PROMPT_LENGTH - length : tailLength;
+            memmove(tail, tail + tailLength - keep, keep);
+            memcpy(tail + keep, buffer, length);
+            tailLength = keep + length;
+        }
+        if (tailLength == PROMPT_LENGTH && memcmp(tail, PROMPT, PROMPT_LENGTH) == 0) {
+            return;
+        }
+    }
+}
+
+static void start_shell(shell *shell, const char *historyFile) {
+    shell->fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (shell->fd < 0 || grantpt(shell->fd) < 0 || unlockpt(shell->fd) < 0) {
+        fail("error");
+    }
+    char *terminal = ptsname(shell->fd);
+    char *argv[8];
+    shell_argv(argv, historyFile);
+    shell->pid = fork();
+    if (shell->pid < 0) {
+        fail("error");
+    }
+    if (shell->pid == 0) {
+        //A session of its own, with the terminal as its controlling terminal (so it has job control, as for a user).
+        setsid();
+        int slave = open(terminal, O_RDWR);
+        if (slave < 0) {
+            _exit(127);
+        }
+        struct termios settings;
+        tcgetattr(slave, &settings);
+        settings.c_lflag &= ~ECHO; //we don't want our own lines back.
+        tcsetattr(slave, TCSANOW, &settings);
+        dup2(slave, STDIN_FILENO);
+        dup2(slave, STDOUT_FILENO);
+        dup2(slave, STDERR_FILENO);
+        if (slave > STDERR_FILENO) {
+            close(slave);
+        }
+        execv(shellPath, argv);
+        _exit(127);
+    }
+    wait_prompt(shell);
+}
+
+static void stop_shell(shell *shell) {
+    if (write(shell->fd, "exit\n", 5) != 5) {
+        kill(shell->pid, SIGKILL);
+    }
+    waitpid(shell->pid, NULL, 0);
+    close(shell->fd);
+}
+
+static double run_line(shell *shell, const char *line) {
+    size_t length = strlen(line);
+    double start = now_seconds();
+    if (write(shell->fd, line, length) != (ssize_t) length || write(shell->fd, "\n", 1) != 1) {
+        fail("error");
+    }
+    wait_prompt(shell);
+    return (now_seconds() - start) * 1e6;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+static void add_result(const char *name, double *times, int runs) {
+    if (resultCount == MAX_CASES) {
+        fprintf(stderr, "error: too many cases\n");
+        exit(1);
+    }
+    qsort(times, runs, sizeof(double), compare_doubles);
+    result *result = &results[resultCount++];
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->runs = runs;
+    result->min = times[0];
+    result->median = times[runs / 2];
+    result->p90 = times[runs * 9 / 10];
+    printf("%-18s %8d %12.1f %12.1f %12.1f\n", result->name, runs, result->min, result->median, result->p90);
+    fflush(stdout);
+}
+
+static double *allocate_times(int runs) {
+    double *times = malloc(runs * sizeof(double));
+    if (!times) {
+        fail("error");
+    }
+    return times;
+}
+
+static void bench_line(const char *name, const char *line, int runs, const char *historyFile) {
+    shell shell;
+    start_shell(&shell, historyFile);
+    double *times = allocate_times(runs);
+    int i;
+    for (i = 0; i < WARMUP; i++) {
+        run_line(&shell, line);
+    }
+    for (i = 0; i < runs; i++) {
+        times[i] = run_line(&shell, line);
+    }
+    stop_shell(&shell);
+    add_result(name, times, runs);
+    free(times);
+}
+
+static void bench_startup(const char *name, int runs, const char *historyFile) {
+    double *times = allocate_times(runs);
+    int i;
+    for (i = 0; i < runs; i++) {
+        shell shell;
+        double start = now_seconds();
+        start_shell(&shell, historyFile);
+        times[i] = (now_seconds() - start) * 1e6;
+        stop_shell(&shell);
+    }
+    add_result(name, times, runs);
+    free(times);
+}
+
+static void bench_history_add(const char *script, const char *historyFile, int runs) {
+    //No terminal here - the lines come from a file, and the output goes away.
+    double *times = allocate_times(runs);
+    char *argv[8];
+    shell_argv(argv, historyFile);
+    int i;
+    for (i = 0; i < runs; i++) {
+        double start = now_seconds();
+        pid_t pid = fork();
+        if (pid < 0) {
+            fail("error");
+        }
+        if (pid == 0) {
+            int in = open(script, O_RDONLY);
+            int out = open("/dev/null", O_WRONLY);
+            if (in < 0 || out < 0) {
+                _exit(127);
+            }
+            dup2(in, STDIN_FILENO);
+            dup2(out, STDOUT_FILENO);
+            dup2(out, STDERR_FILENO);
+            execv(shellPath, argv);
+            _exit(127);
+        }
+        waitpid(pid, NULL, 0);
+        times[i] = (now_seconds() - start) * 1e6 / HISTORY_LINES;
+    }
+    add_result("history_add", times, runs);
+    free(times);
+}
+
+static void write_lines(const char *file, const char *line, int count) {
+    FILE *out = fopen(file, "w");
+    if (!out) {
+        fail(file);
+    }
+    int i;
+    for (i = 0; i < count; i++) {
+        fprintf(out, "%s\n", line);
+    }
+    fclose(out);
+}
+
+static void save_results(const char *file) {
+    FILE *out = fopen(file, "w");
+    if (!out) {
+        fail(file);
+    }
+    int i;
+    for (i = 0; i < resultCount; i++) {
+        fprintf(out, "%s %.1f\n", results[i].name, results[i].median);
+    }
+    fclose(out);
+}
+
+static int check_results(const char *file, double tolerance) {
+    //Every case in the file is compared to the median we got now, cases that are only on one side are skipped.
+    FILE *in = fopen(file, "r");
+    if (!in) {
+        fail(file);
+    }
+    int regressions = 0;
+    char name[32];
+    double baseline;
+    while (fscanf(in, "%31s %lf", name, &baseline) == 2) {
+        int i;
+        for (i = 0; i < resultCount; i++) {
+            if (strcmp(results[i].name, name) != 0) {
+                continue;
+            }
+            double change = (results[i].median - baseline) / baseline;
+            bool slower = change > tolerance;
+            printf("%-18s %12.1f %12.1f %+8.1f%%%s\n", name, baseline, results[i].median, change * 100,
+                   slower ? "  SLOWER" : "");
+            regressions += slower;
+        }
+    }
+    fclose(in);
+    return regressions;
+}
+
+int main(int argc, char **argv) {
+    int runs = DEFAULT_RUNS;
+    double tolerance = DEFAULT_TOLERANCE;
+    const char *outFile = NULL;
+    const char *checkFile = NULL;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc && atoi(argv[i + 1]) >= 10) {
+            runs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+            shellPath = argv[++i];
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            strategy = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            outFile = argv[++i];
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            checkFile = argv[++i];
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-n runs] [-x myshell] [-s strategy] [-o results] [-c baseline [-T tolerance]]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    char directory[] = "/tmp/myshell-bench-XXXXXX";
+    if (!mkdtemp(directory)) {
+        fail("error");
+    }
+    char historyFile[64];
+    char historyCopy[64];
+    char script[64];
+    snprintf(historyFile, sizeof(historyFile), "%s/history", directory);
+    snprintf(historyCopy, sizeof(historyCopy), "%s/history-add", directory);
+    snprintf(script, sizeof(script), "%s/script", directory);
+    write_lines(historyFile, "jobs", HISTORY_LINES);
+    write_lines(script, "jobs", HISTORY_LINES);
+
+    printf("shell: %s, strategy: %s\n", shellPath, strategy ? strategy : "default");
+    printf("%-18s %8s %12s %12s %12s\n", "case", "runs", "min(us)", "median(us)", "p90(us)");
+    bench_line("builtin", "jobs", runs, NULL);
+    bench_line("external", "true", runs, NULL);
+    bench_line("external_path", "/bin/true", runs, NULL);
+    bench_line("background", "true &", runs, NULL);
+    bench_line("pipeline_2", "true | true", runs, NULL);
+    bench_line("pipeline_3", "echo x | cat | cat", runs, NULL);
+    bench_startup("startup", runs / 4, NULL);
+    bench_startup("startup_history", runs / 4, historyFile);
+    bench_line("history_recall", "!5000", runs, historyFile);
+    bench_line("history_print", "history", runs / 10, historyFile);
+    write_lines(historyCopy, "jobs", HISTORY_LINES);
+    bench_history_add(script, historyCopy, 5);
+
+    unlink(historyFile);
+    unlink(historyCopy);
+    unlink(script);
+    rmdir(directory);
+
+    if (outFile) {
+        save_results(outFile);
+    }
+    if (checkFile) {
+        printf("%-18s %12s %12s %9s\n", "case", "baseline(us)", "now(us)", "change");
+        int regressions = check_results(checkFile, tolerance);
+        if (regressions) {
+            printf("%d case(s) more than %.0f%% slower\n", regressions, tolerance * 100);
+            return 1;
+        }
+    }
+    return 0;
+}
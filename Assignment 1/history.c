@@ -0,0 +1,233 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include "history.h"
+
+typedef struct {
+    const char *text; //in the arena (NUL terminated) or in the mapped file (ends with a newline).
+    size_t length;
+} history_entry;
+
+static history_entry entries[HISTORY_ENTRIES];
+static size_t first = 0; //slot of the oldest entry.
+static size_t count = 0;
+static long counter = 0; //number of the newest entry.
+
+static char arena[HISTORY_ARENA];
+static size_t arenaStart = 0; //offset of the oldest entry in the arena.
+static size_t arenaEnd = 0; //where the next entry goes.
+static bool arenaEmpty = true;
+
+static int historyFd = -1;
+
+static bool in_arena(const char *text) {
+    return text >= arena && text < arena + HISTORY_ARENA;
+}
+
+static void drop_oldest(void) {
+    bool fromArena = in_arena(entries[first].text);
+    first = (first + 1) % HISTORY_ENTRIES;
+    count--;
+    if (!fromArena) {
+        return;
+    }
+    //The arena entries are the newest ones, so the next entry (if there is one) is the next one in the arena.
+    if (count == 0) {
+        arenaStart = 0;
+        arenaEnd = 0;
+        arenaEmpty = true;
+    } else {
+        arenaStart = (size_t) (entries[first].text - arena);
+    }
+}
+
+static bool arena_fits(size_t size) {
+    if (arenaEmpty) {
+        return true;
+    }
+    if (arenaEnd > arenaStart) {
+        return size <= HISTORY_ARENA - arenaEnd || size <= arenaStart; //at the end, or from the start (we wrap).
+    }
+    return size <= arenaStart - arenaEnd;
+}
+
+static char *arena_alloc(size_t size) {
+    //arena_fits was true.
+    size_t offset;
+    if (arenaEmpty) {
+        offset = 0;
+        arenaStart = 0;
+    } else if (arenaEnd > arenaStart && size > HISTORY_ARENA - arenaEnd) {
+        offset = 0; //the bytes after arenaEnd stay unused until we wrap again.
+    } else {
+        offset = arenaEnd;
+    }
+    arenaEnd = offset + size;
+    arenaEmpty = false;
+    return arena + offset;
+}
+
+static void push_entry(const char *text, size_t length) {
+    if (count == HISTORY_ENTRIES) {
+        drop_oldest();
+    }
+    size_t slot = (first + count) % HISTORY_ENTRIES;
+    entries[slot].text = text;
+    entries[slot].length = length;
+    count++;
+    counter++;
+}
+
+void history_add(const char *command) {
+    size_t length = strlen(command);
+    if (length >= HISTORY_ARENA) {
+        length = HISTORY_ARENA - 1;
+    }
+    while (!arena_fits(length + 1)) {
+        drop_oldest();
+    }
+    char *text = arena_alloc(length + 1);
+    memcpy(text, command, length);
+    text[length] = '\0';
+    push_entry(text, length);
+
+    if (historyFd >= 0) {
+        //One write (the file is O_APPEND), so two shells on the same file don't mix their lines.
+        struct iovec parts[2];
+        parts[0].iov_base = text;
+        parts[0].iov_len = length;
+        parts[1].iov_base = "\n";
+        parts[1].iov_len = 1;
+        if (writev(historyFd, parts, 2) < 0) {
+            perror("error");
+        }
+    }
+}
+
+const char *history_get(long number, size_t *length) {
+    long oldest = counter - (long) count + 1;
+    if (number < oldest || number > counter) {
+        return NULL;
+    }
+    history_entry *entry = &entries[(first + (size_t) (number - oldest)) % HISTORY_ENTRIES];
+    *length = entry->length;
+    return entry->text;
+}
+
+const char *history_last(void) {
+    size_t length;
+    return history_get(counter, &length);
+}
+
+void history_print(FILE *out) {
+    long number;
+    for (number = counter; number > counter - (long) count; number--) {
+        size_t length;
+        const char *text = history_get(number, &length);
+        fprintf(out, "%ld %.*s\r\n", number, (int) length, text);
+    }
+}
+
+void history_clear(void) {
+    first = 0;
+    count = 0;
+    counter = 0;
+    arenaStart = 0;
+    arenaEnd = 0;
+    arenaEmpty = true;
+}
+
+void history_init(const char *file) {
+    if (!file) {
+        return;
+    }
+    historyFd = open(file, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    struct stat fileStat;
+    if (historyFd < 0 || fstat(historyFd, &fileStat) < 0) {
+        perror("error");
+        return;
+    }
+    if (fileStat.st_size == 0) {
+        return;
+    }
+    //The mapping stays for the whole session, the file only grows (we append), so the entries stay valid.
+    size_t size = (size_t) fileStat.st_size;
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, historyFd, 0);
+    if (map == MAP_FAILED) {
+        perror("error");
+        return;
+    }
+
+    //Only the last HISTORY_ENTRIES lines, found from the end - the size of the file doesn't matter.
+    const char *end = map + size;
+    if (end[-1] == '\n') {
+        end--;
+    }
+    const char *starts[HISTORY_ENTRIES];
+    size_t lines = 0;
+    const char *lineEnd = end;
+    while (lines < HISTORY_ENTRIES && lineEnd >= map) {
+        const char *newline = memrchr(map, '\n', (size_t) (lineEnd - map));
+        starts[lines++] = newline ? newline + 1 : map;
+        if (!newline) {
+            break;
+        }
+        lineEnd = newline;
+    }
+    while (lines > 0) {
+        lines--;
+        const char *start = starts[lines];
+        const char *stop = memchr(start, '\n', (size_t) (end - start));
+        push_entry(start, (size_t) ((stop ? stop : end) - start));
+    }
+}
+
+int history_expand(char **line, size_t *size) {
+    char *text = *line;
+    if (text[0] != '!' || !text[1]) {
+        return 0;
+    }
+    long number;
+    char *rest;
+    if (text[1] == '!') {
+        number = counter;
+        rest = text + 2;
+    } else {
+        number = strtol(text + 1, &rest, 10);
+        if (rest == text + 1) { //"!abc", not ours.
+            return 0;
+        }
+        if (number < 0) {
+            number = counter + number + 1;
+        }
+    }
+    size_t length;
+    const char *entry = history_get(number, &length);
+    if (!entry) {
+        fprintf(stdout, "error: %.*s: event not found\n", (int) (rest - text), text);
+        return -1;
+    }
+
+    //line = the entry, and then whatever came after the event.
+    size_t restOffset = (size_t) (rest - text);
+    size_t restLength = strlen(rest);
+    if (length + restLength + 1 > *size) {
+        *size = length + restLength + 1;
+        text = realloc(text, *size);
+        if (!text) {
+            perror("error");
+            exit(1);
+        }
+        *line = text;
+    }
+    memmove(text + length, text + restOffset, restLength + 1);
+    memcpy(text, entry, length);
+    return 1;
+}
@@ -0,0 +1,45 @@
+#ifndef _HISTORY_H_
+#define _HISTORY_H_
+
+#include <stddef.h>
+#include <stdio.h>
+
+//Command history - a ring of the last entries, their text in one arena that is also used as a ring
+//(the oldest entries make room for the new ones), so an entry is found by its number in O(1).
+//With a history file, the file is mapped on start and its last lines are the first entries (they point into
+//the mapping, nothing is copied), and every new entry is appended to the file.
+
+#define HISTORY_ENTRIES 10000 //entries we keep.
+#define HISTORY_ARENA (1 << 20) //bytes for the text of the entries of this session.
+
+/**
+ * @param file - the history file (created if it is not there), NULL for none.
+ */
+void history_init(const char *file);
+
+//Adds a command, entries are numbered from 1 (since the start or the last history_clear).
+void history_add(const char *command);
+
+/**
+ * @param number - number of the entry, as in history_print.
+ * @return the text (not NUL terminated), NULL if there is no such entry.
+ */
+const char *history_get(long number, size_t *length);
+
+//The last command we added, NUL terminated.
+const char *history_last(void);
+
+//Newest first, "number command" on every line.
+void history_print(FILE *out);
+
+void history_clear(void);
+
+/**
+ * Replaces "!!" (the last command), "!n" (entry n) or "!-n" (n commands back) at the start of the line.
+ * @param line - NUL terminated, from malloc with room for size bytes (as getline leaves it), it grows if needed.
+ * @return 1 if the line was expanded, 0 if it has nothing to expand, -1 (after printing an error) if
+ * there is no such entry.
+ */
+int history_expand(char **line, size_t *size);
+
+#endif
@@ -0,0 +1,327 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "jobs.h"
+#include "stats.h"
+
+static job **jobs = NULL; //the handler walks this array, so it only changes with SIGCHLD blocked.
+static int jobCount = 0;
+static int jobCapacity = 0;
+static int maxJobs = 0;
+static unsigned long jobSerial = 0;
+static bool jobControl = false;
+static sigset_t oldMask; //the mask from before jobs_block.
+
+static void add_usage(struct rusage *total, const struct rusage *usage) {
+    timeradd(&total->ru_utime, &usage->ru_utime, &total->ru_utime);
+    timeradd(&total->ru_stime, &usage->ru_stime, &total->ru_stime);
+    if (usage->ru_maxrss > total->ru_maxrss) {
+        total->ru_maxrss = usage->ru_maxrss;
+    }
+    total->ru_nvcsw += usage->ru_nvcsw;
+    total->ru_nivcsw += usage->ru_nivcsw;
+}
+
+static void mark_child(pid_t pid, int status, const struct rusage *usage) {
+    int i;
+    for (i = 0; i < jobCount; i++) {
+        job *job = jobs[i];
+        int j;
+        for (j = 0; j < job->count; j++) {
+            if (job->pids[j] != pid) {
+                continue;
+            }
+            if (WIFSTOPPED(status)) {
+                job->stopped = 1;
+            } else {
+                job->pids[j] = 0;
+                job->status = status;
+                add_usage(&job->usage, usage);
+                if (job->alive == 1) {
+                    clock_gettime(CLOCK_MONOTONIC, &job->ended);
+                }
+                job->alive--;
+            }
+            return;
+        }
+    }
+}
+
+static void reap_children(int signal) {
+    (void) signal;
+    int savedErrno = errno; //the code we interrupted may still look at errno.
+    pid_t pid;
+    int status;
+    struct rusage usage;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED, &usage)) > 0) {
+        mark_child(pid, status, &usage);
+    }
+    errno = savedErrno;
+}
+
+void jobs_init(int maxBackground, bool control) {
+    maxJobs = maxBackground;
+    jobControl = control;
+    sigprocmask(SIG_SETMASK, NULL, &oldMask);
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = reap_children;
+    action.sa_flags = SA_RESTART; //fgets of the prompt just goes on.
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, NULL);
+}
+
+bool jobs_control(void) {
+    return jobControl;
+}
+
+void jobs_give_terminal(pid_t pgid) {
+    //We are not in the foreground group when we take the terminal back, so SIGTTOU is blocked meanwhile.
+    sigset_t ttou;
+    sigset_t old;
+    sigemptyset(&ttou);
+    sigaddset(&ttou, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &ttou, &old);
+    tcsetpgrp(STDIN_FILENO, pgid);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+}
+
+void jobs_block(void) {
+    sigset_t child;
+    sigemptyset(&child);
+    sigaddset(&child, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &child, &oldMask);
+}
+
+void jobs_unblock(void) {
+    sigprocmask(SIG_SETMASK, &oldMask, NULL);
+}
+
+const sigset_t *jobs_child_mask(void) {
+    return &oldMask;
+}
+
+static void wait_for_child(void) {
+    //Sleeps until the handler ran (SIGCHLD is blocked outside of it, so we can't miss it).
+    sigset_t mask = oldMask;
+    sigdelset(&mask, SIGCHLD);
+    sigsuspend(&mask);
+}
+
+static void remove_job(int index) {
+    job *job = jobs[index];
+    if (job->alive == 0) {
+        stats_record(job);
+    }
+    free(job->pids);
+    free(job->command);
+    free(job->name);
+    free(job);
+    jobCount--;
+    for (; index < jobCount; index++) {
+        jobs[index] = jobs[index + 1];
+    }
+}
+
+static int find_job(int id) {
+    //id 0 - the last job.
+    int i;
+    for (i = jobCount - 1; i >= 0; i--) {
+        if (jobs[i]->background && (id == 0 || jobs[i]->id == id)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int running_background(void) {
+    int count = 0;
+    int i;
+    for (i = 0; i < jobCount; i++) {
+        count += jobs[i]->background && jobs[i]->alive > 0 && !jobs[i]->stopped;
+    }
+    return count;
+}
+
+static void drop_done(bool tell) {
+    int i = 0;
+    while (i < jobCount) {
+        if (jobs[i]->background && jobs[i]->alive == 0) {
+            if (tell) {
+                fprintf(stdout, "[%d] Done %s\n", jobs[i]->id, jobs[i]->command);
+            }
+            remove_job(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+job *jobs_start(const char *command, const char *name, int count, bool background) {
+    jobs_block();
+    if (background) {
+        //Up to maxJobs running at once, the rest wait here (so the number of our processes stays bounded).
+        while (running_background() >= maxJobs) {
+            wait_for_child();
+            drop_done(jobControl);
+        }
+    }
+
+    if (jobCount == jobCapacity) {
+        int capacity = jobCapacity ? jobCapacity * 2 : 16;
+        job **bigger = realloc(jobs, capacity * sizeof(job *));
+        if (!bigger) {
+            perror("error");
+            exit(1);
+        }
+        jobs = bigger;
+        jobCapacity = capacity;
+    }
+    job *job = calloc(1, sizeof(*job));
+    if (!job) {
+        perror("error");
+        exit(1);
+    }
+    job->pids = calloc(count, sizeof(pid_t));
+    job->command = strdup(command);
+    job->name = strdup(name);
+    if (!job->pids || !job->command || !job->name) {
+        perror("error");
+        exit(1);
+    }
+    job->count = count;
+    job->background = background;
+    job->id = jobCount ? jobs[jobCount - 1]->id + 1 : 1;
+    job->serial = ++jobSerial;
+    clock_gettime(CLOCK_MONOTONIC, &job->started);
+    jobs[jobCount++] = job;
+    return job;
+}
+
+static void wait_foreground(job *job) {
+    //SIGCHLD is blocked.
+    while (job->alive > 0 && !job->stopped) {
+        wait_for_child();
+    }
+    if (jobControl && job->pgid > 0) {
+        jobs_give_terminal(getpgrp());
+    }
+    if (job->alive > 0) { //ctrl-z, it goes on as a stopped background job.
+        job->background = true;
+        fprintf(stdout, "\n[%d] Stopped %s\n", job->id, job->command);
+    } else {
+        int i;
+        for (i = 0; i < jobCount; i++) {
+            if (jobs[i] == job) {
+                remove_job(i);
+                break;
+            }
+        }
+    }
+}
+
+void jobs_started(job *job) {
+    if (job->alive == 0) { //no processes (the shell did all of it, or nothing started), nothing to reap.
+        clock_gettime(CLOCK_MONOTONIC, &job->ended);
+    }
+    if (!job->background) {
+        wait_foreground(job);
+    } else if (jobControl && job->alive > 0) {
+        fprintf(stdout, "[%d] %d\n", job->id, (int) job->pgid);
+    }
+    jobs_unblock();
+}
+
+void jobs_notify(void) {
+    jobs_block();
+    drop_done(jobControl);
+    jobs_unblock();
+}
+
+void jobs_list(void) {
+    jobs_block();
+    int i;
+    for (i = 0; i < jobCount; i++) {
+        job *job = jobs[i];
+        const char *state = job->alive == 0 ? "Done" : job->stopped ? "Stopped" : "Running";
+        fprintf(stdout, "[%d] %-8s %s\n", job->id, state, job->command);
+    }
+    drop_done(false);
+    jobs_unblock();
+}
+
+void jobs_wait(int id) {
+    jobs_block();
+    if (id >= 0 && find_job(id) < 0) {
+        fprintf(stdout, "error: no such job\n");
+    } else {
+        while (1) {
+            int index = find_job(id);
+            bool waiting = id >= 0 ? jobs[index]->alive > 0 && !jobs[index]->stopped : running_background() > 0;
+            if (!waiting) {
+                break;
+            }
+            wait_for_child();
+        }
+        drop_done(false); //we waited for them, nothing to tell.
+    }
+    jobs_unblock();
+}
+
+void jobs_fg(int id) {
+    jobs_block();
+    int index = find_job(id);
+    if (index < 0) {
+        fprintf(stdout, "error: no such job\n");
+        jobs_unblock();
+        return;
+    }
+    job *job = jobs[index];
+    fprintf(stdout, "%s\n", job->command);
+    fflush(stdout);
+    job->background = false;
+    if (jobControl && job->pgid > 0) {
+        jobs_give_terminal(job->pgid);
+    }
+    if (job->stopped) {
+        job->stopped = 0;
+        if (job->pgid > 0) {
+            kill(-job->pgid, SIGCONT);
+        } else {
+            int i;
+            for (i = 0; i < job->count; i++) {
+                if (job->pids[i] > 0) {
+                    kill(job->pids[i], SIGCONT);
+                }
+            }
+        }
+    }
+    wait_foreground(job);
+    jobs_unblock();
+}
+
+bool jobs_done(unsigned long serial, bool wait) {
+    jobs_block();
+    bool done;
+    while (1) {
+        int i;
+        done = true;
+        for (i = 0; i < jobCount; i++) {
+            if (jobs[i]->serial == serial) {
+                done = jobs[i]->alive == 0;
+                break;
+            }
+        }
+        if (done || !wait) {
+            break;
+        }
+        wait_for_child();
+    }
+    jobs_unblock();
+    return done;
+}
@@ -0,0 +1,79 @@
+#ifndef _JOBS_H_
+#define _JOBS_H_
+
+#include <signal.h>
+#include <stdbool.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <time.h>
+
+//Job table - every command line that starts processes is a job, until all of its processes are reaped.
+//The SIGCHLD handler reaps the children as soon as they exit (so background jobs don't stay zombies until
+//somebody waits for them) and marks them in the table. The shell only changes the table with SIGCHLD blocked,
+//and waits with sigsuspend.
+//The handler reaps with wait4, so every job also gets the resources its processes used (see stats.h).
+
+typedef struct {
+    int id; //the number of the job in jobs/fg/wait.
+    unsigned long serial; //counts all the jobs we started, never reused (an id is reused once the table is empty).
+    pid_t pgid; //process group of the job, 0 without job control.
+    pid_t *pids; //pids[i] is the process of stage i, 0 if the stage has no process (or it was reaped).
+    int count; //stages.
+    volatile sig_atomic_t alive; //processes not reaped yet.
+    volatile sig_atomic_t stopped; //a process of the job was stopped (ctrl-z).
+    int status; //wait status of the last process that ended.
+    bool background;
+    bool timed; //"time" before the command, its times are printed when it ends.
+    char *command;
+    char *name; //the command of the first stage, for the stats.
+    struct timespec started; //CLOCK_MONOTONIC
+    struct timespec ended; //when the last process was reaped.
+    struct rusage usage; //of all the processes, summed up (the max rss is the biggest one).
+} job;
+
+/**
+ * Installs the SIGCHLD handler.
+ * @param maxBackground - how many background jobs may run at once, a new one waits until one of them ends.
+ * @param control - job control, process groups and the terminal (only for an interactive shell).
+ */
+void jobs_init(int maxBackground, bool control);
+
+//With a terminal we have job control - every job gets its own process group, and the foreground job the terminal.
+bool jobs_control(void);
+void jobs_give_terminal(pid_t pgid);
+
+//For code that waits for its own children (with SIGCHLD blocked the handler doesn't take them).
+void jobs_block(void);
+void jobs_unblock(void);
+
+//The mask from before jobs_block - the children get it before exec, not our SIGCHLD blocked.
+const sigset_t *jobs_child_mask(void);
+
+/**
+ * Adds a job for a command line with count stages, SIGCHLD stays blocked until jobs_started
+ * (so no process of the job is reaped before its pid is in the table).
+ * @param name - the command of the first stage.
+ * @return the job, NULL (after printing an error) if it can't start.
+ */
+job *jobs_start(const char *command, const char *name, int count, bool background);
+
+/**
+ * The processes of the job are started - a foreground job is waited for here.
+ */
+void jobs_started(job *job);
+
+//Removes the background jobs that ended (and tells about them, with a terminal). Called before every prompt.
+void jobs_notify(void);
+
+//The builtins, id 0 is the last job.
+void jobs_list(void);
+void jobs_wait(int id); //id -1 waits for all the background jobs.
+void jobs_fg(int id);
+
+/**
+ * @param wait - sleeps until the job ended.
+ * @return true if the job with that serial ended (or there is no such job any more).
+ */
+bool jobs_done(unsigned long serial, bool wait);
+
+#endif
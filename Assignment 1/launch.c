@@ -0,0 +1,240 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include "jobs.h"
+#include "launch.h"
+#include "path_cache.h"
+
+#define CLONE_STACK_SIZE (256 * 1024)
+
+extern char **environ;
+
+const char *launchNames[LAUNCH_STRATEGIES] = {"fork", "vfork", "clone", "posix_spawn"};
+
+//What the child of vfork/clone needs, the child runs on our memory so it can also write back why exec failed.
+typedef struct {
+    const char *path; //the file from the command hash.
+    char *const *argv;
+    const launch_options *options;
+    sigset_t oldMask; //ours, from before launch_shared blocked everything.
+    sigset_t childMask; //what the command starts with (jobs_child_mask).
+    volatile int error;
+} launch_job;
+
+static char *cloneStack = NULL; //one stack is enough, with CLONE_VFORK we wait until the child is done with it.
+
+int launch_strategy(const char *name) {
+    int i;
+    for (i = 0; i < LAUNCH_STRATEGIES; i++) {
+        if (strcmp(name, launchNames[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int setup_child(const launch_options *options) {
+    //In the child, before exec - only system calls, so it is fine on the memory of the shell too.
+    if (!options) {
+        return 0;
+    }
+    if (options->pgid >= 0 && setpgid(0, options->pgid) < 0) {
+        return -1;
+    }
+    if (options->in >= 0 && options->in != STDIN_FILENO && dup2(options->in, STDIN_FILENO) < 0) {
+        return -1;
+    }
+    if (options->out >= 0 && options->out != STDOUT_FILENO && dup2(options->out, STDOUT_FILENO) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static int exec_child(void *arg) {
+    //Only exec and _exit in here - the child shares the memory (and the stdio buffers) of the shell.
+    launch_job *job = arg;
+    sigprocmask(SIG_SETMASK, &job->childMask, NULL);
+    if (setup_child(job->options) == 0) {
+        execv(job->path, job->argv);
+    }
+    job->error = errno;
+    _exit(127);
+}
+
+static pid_t launch_fork(const char *path, char *const argv[], const launch_options *options) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        //Son process
+        int status = 0;
+        sigprocmask(SIG_SETMASK, jobs_child_mask(), NULL); //not SIGCHLD blocked, as jobs_start left it for us.
+        status = setup_child(options);
+        if (status == 0) {
+            status = execv(path, argv);
+        }
+        if (status < 0 && errno == ENOENT) { //The file is gone since we hashed it, we can't tell our parent.
+            status = execvp(argv[0], argv);
+        }
+        if (status < 0) { //execvp failed, error...
+            perror("error");
+            //_exit and not exit - exit would flush our copy of the stdio buffers (the prompt was printed twice),
+            //and seek the shared script fd back to where the stdin buffer of the shell is.
+            _exit(1);
+        }
+    }
+    return pid;
+}
+
+static pid_t launch_shared(int strategy, const char *path, char *const argv[], const launch_options *options) {
+    //vfork and clone: the signals are blocked until the child called exec, a handler of ours
+    //must not run in the child on our memory.
+    launch_job job;
+    job.path = path;
+    job.argv = argv;
+    job.options = options;
+    job.childMask = *jobs_child_mask();
+    job.error = 0;
+    sigset_t all;
+    sigfillset(&all);
+    sigprocmask(SIG_BLOCK, &all, &job.oldMask);
+
+    pid_t pid;
+    if (strategy == LAUNCH_VFORK) {
+        pid = vfork();
+        if (pid == 0) {
+            exec_child(&job);
+        }
+    } else {
+        if (!cloneStack) {
+            cloneStack = malloc(CLONE_STACK_SIZE);
+            if (!cloneStack) {
+                perror("error");
+                exit(1);
+            }
+        }
+        //The stack grows down, so the child starts at its end.
+        pid = clone(exec_child, cloneStack + CLONE_STACK_SIZE, CLONE_VM | CLONE_VFORK | SIGCHLD, &job);
+    }
+    int forkError = errno;
+    sigprocmask(SIG_SETMASK, &job.oldMask, NULL);
+
+    if (pid < 0) {
+        errno = forkError;
+        return -1;
+    }
+    if (job.error) { //The child is already gone, it only needs to be reaped.
+        waitpid(pid, NULL, 0);
+        errno = job.error;
+        return -1;
+    }
+    return pid;
+}
+
+static pid_t launch_posix_spawn(const char *path, char *const argv[], const launch_options *options) {
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attributes;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawnattr_init(&attributes);
+    short flags = POSIX_SPAWN_SETSIGMASK;
+    posix_spawnattr_setsigmask(&attributes, jobs_child_mask());
+    if (options) {
+        if (options->in >= 0 && options->in != STDIN_FILENO) {
+            posix_spawn_file_actions_adddup2(&actions, options->in, STDIN_FILENO);
+        }
+        if (options->out >= 0 && options->out != STDOUT_FILENO) {
+            posix_spawn_file_actions_adddup2(&actions, options->out, STDOUT_FILENO);
+        }
+        if (options->pgid >= 0) {
+            posix_spawnattr_setpgroup(&attributes, options->pgid);
+            flags |= POSIX_SPAWN_SETPGROUP;
+        }
+    }
+    posix_spawnattr_setflags(&attributes, flags);
+    pid_t pid;
+    int error = posix_spawn(&pid, path, &actions, &attributes, argv, environ);
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return pid;
+}
+
+static pid_t launch_path(int strategy, const char *path, char *const argv[], const launch_options *options) {
+    if (strategy == LAUNCH_FORK) {
+        return launch_fork(path, argv, options);
+    } else if (strategy == LAUNCH_POSIX_SPAWN) {
+        return launch_posix_spawn(path, argv, options);
+    }
+    return launch_shared(strategy, path, argv, options);
+}
+
+pid_t launch_command(int strategy, char *const argv[], const launch_options *options) {
+    const char *path = path_cache_lookup(argv[0]);
+    if (!path) {
+        return -1;
+    }
+    pid_t pid = launch_path(strategy, path, argv, options);
+    if (pid < 0 && errno == ENOENT && path != argv[0]) {
+        //The file we hashed is gone (moved to another PATH directory?), one more try with a fresh search.
+        path_cache_forget(argv[0]);
+        path = path_cache_lookup(argv[0]);
+        if (!path) {
+            return -1;
+        }
+        pid = launch_path(strategy, path, argv, options);
+    }
+    if (pid > 0 && options && options->pgid >= 0) {
+        //The child does it too, whoever is first - so the group exists before we start the next stage in it.
+        setpgid(pid, options->pgid ? options->pgid : pid);
+    }
+    return pid;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+void launch_bench(char *const argv[], int count, int ballastMb) {
+    char *ballast = NULL;
+    if (ballastMb > 0) {
+        size_t size = (size_t) ballastMb * 1024 * 1024;
+        ballast = malloc(size);
+        if (!ballast) {
+            perror("error");
+            exit(1);
+        }
+        memset(ballast, 1, size); //touching every page, so fork has page tables to copy.
+    }
+    fflush(stdout); //the fork children would print what is still in the buffer again.
+
+    int strategy;
+    for (strategy = 0; strategy < LAUNCH_STRATEGIES; strategy++) {
+        double start = now_seconds();
+        int runs;
+        for (runs = 0; runs < count; runs++) {
+            pid_t pid = launch_command(strategy, argv, NULL);
+            if (pid < 0) {
+                perror("error");
+                break;
+            }
+            waitpid(pid, NULL, 0);
+        }
+        double seconds = now_seconds() - start;
+        if (runs > 0) {
+            fprintf(stdout, "%-12s %10.0f spawns/s %10.1f us/spawn (%d runs)\n", launchNames[strategy],
+                    runs / seconds, seconds * 1e6 / runs, runs);
+        }
+    }
+    free(ballast);
+}
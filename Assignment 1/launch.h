@@ -0,0 +1,47 @@
+#ifndef _LAUNCH_H_
+#define _LAUNCH_H_
+
+#include <sys/types.h>
+
+//Starting external commands. fork copies the page tables of the whole shell on every command, the other
+//strategies start the child on the memory of the shell (the shell waits until the child called exec),
+//so their cost doesn't grow with the size of the shell.
+
+#define LAUNCH_FORK 0 //fork + exec, the old way.
+#define LAUNCH_VFORK 1
+#define LAUNCH_CLONE 2 //clone(CLONE_VM | CLONE_VFORK) with a stack of our own.
+#define LAUNCH_POSIX_SPAWN 3 //posix_spawn.
+#define LAUNCH_STRATEGIES 4
+
+#define LAUNCH_DEFAULT LAUNCH_POSIX_SPAWN
+
+extern const char *launchNames[LAUNCH_STRATEGIES];
+
+typedef struct {
+    int in; //fd that becomes the stdin of the child, -1 keeps ours.
+    int out; //fd that becomes the stdout of the child, -1 keeps ours.
+    pid_t pgid; //process group the child joins, 0 starts a new group led by the child, -1 stays in ours.
+} launch_options;
+
+/**
+ * @return the strategy with that name (as in launchNames), -1 if there is no such strategy.
+ */
+int launch_strategy(const char *name);
+
+/**
+ * Runs argv[0] (searched in PATH, through the command hash of path_cache.h) with argv.
+ * The fds we give the child are dup2'ed to 0/1, every other fd of the shell should be O_CLOEXEC.
+ * @param options - redirections and process group of the child, NULL for none.
+ * @return pid of the child, or -1 with errno set if it could not start (the command is not in PATH, fork failed,
+ * or the command could not be executed - with LAUNCH_FORK that is only known in the child, which prints the error
+ * and exits with 1).
+ */
+pid_t launch_command(int strategy, char *const argv[], const launch_options *options);
+
+/**
+ * Starts argv count times with every strategy (waits for every run) and prints the spawns per second.
+ * @param ballastMb - megabytes to allocate and touch first, so we see what a big shell costs to fork.
+ */
+void launch_bench(char *const argv[], int count, int ballastMb);
+
+#endif
@@ -1,3 +1,4 @@
+#define _POSIX_C_SOURCE 200809L
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <stdio.h>
@@ -5,164 +6,247 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include "batch.h"
+#include "history.h"
+#include "jobs.h"
+#include "launch.h"
+#include "path_cache.h"
+#include "pipeline.h"
+#include "stats.h"
+#include "tokenizer.h"
 
-#define BUFFER_SIZE 100
-
-typedef struct Node {
-    char data[BUFFER_SIZE];
-    struct Node *next;
-} Node;
-typedef struct Node *nodePtr;
-
-//Node *create_node(const char *str) {
-//    Node *node = malloc(sizeof *node);
-//    if (!node) {
-////        perror("Memory allocation failed\n");
-//        perror("error");
-//        exit(1);
-//    }
-//    strncpy(node->data, str, BUFFER_SIZE);
-//    node->next = NULL;
-//    return node;
-//}
-
-Node *create_node(const char *str) {
-    Node *node = malloc(sizeof *node);
-    if (!node) {
-        perror("error");
-        exit(1);
+#define DEFAULT_MAX_BACKGROUND 64 //background jobs that may run at once (-b).
+
+
+/**
+ * spawn_bench [-n count] [-m megabytes] [command [args...]] - runs the command (default "true") count times
+ * (default 1000) with every launch strategy, -m makes the shell that many megabytes bigger first.
+ */
+void spawn_bench(char *argv[]) {
+    int count = 1000;
+    int ballastMb = 0;
+    int i = 1;
+    while (argv[i] && argv[i + 1] && (strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "-m") == 0)) {
+        if (argv[i][1] == 'n') {
+            count = atoi(argv[i + 1]);
+        } else {
+            ballastMb = atoi(argv[i + 1]);
+        }
+        i += 2;
     }
-    strncpy(node->data, str, BUFFER_SIZE-1);
-    node->data[BUFFER_SIZE - 1] = '\0';
-    node->next = NULL;
-    return node;
+    char *defaultCommand[] = {"true", NULL};
+    jobs_block(); //the bench waits for its own children.
+    launch_bench(argv[i] ? &argv[i] : defaultCommand, count, ballastMb);
+    jobs_unblock();
 }
 
-
-void print_list(const Node *head, int counter) {
-    const Node *cur = head;
-    while (cur) {
-        fprintf(stdout, "%d %s\r\n", counter--, cur->data);
-        cur = cur->next;
+/**
+ * The job number of "fg 2" / "wait %2".
+ * @return the number, none if there is no argument.
+ */
+int job_argument(char *argv[], int none) {
+    if (!argv[1]) {
+        return none;
     }
+    return atoi(argv[1][0] == '%' ? argv[1] + 1 : argv[1]);
 }
 
-void free_list(Node *head) {
-    Node *cur = head;
-    while (cur) {
-        Node *next = cur->next;
-//        free(cur->data);
-        free(cur);
-        cur = next;
+/**
+ * hash - the commands we know the path of, hash -r - forget them all, hash name... - look the names up now.
+ */
+void hash_builtin(char *argv[]) {
+    if (!argv[1]) {
+        path_cache_print(stdout);
+        return;
+    }
+    if (strcmp(argv[1], "-r") == 0) {
+        path_cache_clear();
+        return;
+    }
+    int i;
+    for (i = 1; argv[i]; i++) {
+        path_cache_forget(argv[i]); //"hash name" searches PATH again, like in bash.
+        if (!path_cache_lookup(argv[i])) {
+            fprintf(stdout, "error: hash: %s: not found\n", argv[i]);
+        }
     }
 }
 
 /**
- * Checks if commands ends with &, also removes it so it won't be in args once we run it.
- * @param string - the raw command string.
- * @return true or false based if & exists.
+ * stats - the times of every command we ran, stats name... - only of those, stats -r - forget them all.
  */
-bool ends_with_ampersand(char *buf) {
-    size_t len = strlen(buf);
-    if (len && buf[len - 1] == '\n') buf[--len] = '\0';
-    if (len && buf[len - 1] == '&') {
-        buf[--len] = '\0';   // actually remove it
-        return true;
+void stats_builtin(char *argv[]) {
+    if (!argv[1]) {
+        if (!stats_print(stdout, NULL)) {
+            fprintf(stdout, "stats: no commands yet\n");
+        }
+        return;
+    }
+    if (strcmp(argv[1], "-r") == 0) {
+        stats_clear();
+        return;
+    }
+    int i;
+    for (i = 1; argv[i]; i++) {
+        if (!stats_print(stdout, argv[i])) {
+            fprintf(stdout, "error: stats: %s: no runs\n", argv[i]);
+        }
     }
-    return false;
 }
 
+bool is_builtin(const char *name) {
+    //The same checks as in main.
+    return strncmp(name, "exit", 4) == 0 || strncmp(name, "clear_history", 13) == 0 ||
+           strncmp(name, "history", 7) == 0 || strncmp(name, "spawn_bench", 11) == 0 || strcmp(name, "jobs") == 0 ||
+           strcmp(name, "wait") == 0 || strcmp(name, "fg") == 0 || strcmp(name, "hash") == 0 ||
+           strcmp(name, "stats") == 0;
+}
+
+int main(int shellArgc, char *shellArgv[]) {
+    //-s <strategy> picks how we start the commands (fork, vfork, clone, posix_spawn - see launch.h).
+    //-b <jobs> is how many background jobs may run at once, the next "&" waits until one of them is done.
+    //-j <workers> [script] - batch mode, see batch.h (the script is stdin if there is none).
+    //-H <file> - history file, it is loaded on start and every command is appended to it (see history.h).
+    //-L <file> - a line with the times and the resources of every command that ends is appended to it (see stats.h).
+    int strategy = LAUNCH_DEFAULT;
+    int maxBackground = DEFAULT_MAX_BACKGROUND;
+    int workers = 0;
+    const char *historyFile = NULL;
+    const char *statsLog = NULL;
+    int option;
+    while ((option = getopt(shellArgc, shellArgv, "s:b:j:H:L:")) != -1) {
+        if (option == 's' && launch_strategy(optarg) >= 0) {
+            strategy = launch_strategy(optarg);
+        } else if (option == 'b' && atoi(optarg) > 0) {
+            maxBackground = atoi(optarg);
+        } else if (option == 'j' && atoi(optarg) > 0) {
+            workers = atoi(optarg);
+        } else if (option == 'H') {
+            historyFile = optarg;
+        } else if (option == 'L') {
+            statsLog = optarg;
+        } else {
+            fprintf(stderr, "usage: %s [-s fork|vfork|clone|posix_spawn] [-b max_background_jobs] [-H history_file] "
+                            "[-L stats_log] [-j workers [script]]\n", shellArgv[0]);
+            exit(1);
+        }
+    }
+    bool batch = workers > 0;
+    FILE *input = stdin;
+    if (batch && optind < shellArgc) {
+        input = fopen(shellArgv[optind], "r");
+        if (!input) {
+            perror("error");
+            exit(1);
+        }
+    }
+    jobs_init(batch ? workers : maxBackground, !batch && isatty(STDIN_FILENO));
+    history_init(historyFile);
+    stats_init(statsLog);
 
-int main(void) {
     close(2);
     dup(1);
-    char command[BUFFER_SIZE];
-
-    int counter = 0; //Counting the amount of commands till clear history. (so we can track how many commands we "used" till now.)
-    nodePtr history_list = NULL;
-    bool isBackground; //flag for is background command.
+    if (batch) {
+        batch_init();
+    }
+    //Both only grow, for the longest line so far (no limit on the line or on the number of words).
+    char *command = NULL;
+    size_t commandSize = 0;
+    command_line line = {0};
 
     while (1) {
-        isBackground = false;//flag reset
-
-        fprintf(stdout, "my-shell> ");
-        memset(command, 0, BUFFER_SIZE);
-        fgets(command, BUFFER_SIZE, stdin);
-
-        size_t len = strlen(command);
+        jobs_notify(); //Also drops the background jobs that are done.
+        if (!batch) {
+            fprintf(stdout, "my-shell> ");
+        }
+        ssize_t len = getline(&command, &commandSize, input);
+        if (len < 0) { //End of the input (or the script).
+            break;
+        }
         if (len && command[len-1] == '\n')
             command[len-1] = '\0';          /* remove the LF */
 
-        //Commands adding to the history list (in case its history_list/exit , it will be removed, so it's an okay behavior)
-        nodePtr newCommand = create_node(command);
-        //Attaching the commands to the list (supporting both case if it's empty or not empty).
-        if (!history_list) {
-            history_list = newCommand;
-        } else {
-            newCommand->next = history_list;
-            history_list = newCommand;
+        //!! / !n / !-n - the command from the history (printed, so we see what runs).
+        int expanded = history_expand(&command, &commandSize);
+        if (expanded < 0) {
+            continue;
         }
-        counter++; //commands history counter
-
-        //Checking if commands needs to run in the background.
-        if (ends_with_ampersand(command)) {
-            isBackground = true;
+        if (expanded) {
+            fprintf(stdout, "%s\n", command);
         }
 
-        //Tokenizing & Splitting the command
-        char *tokenCommand = strtok(command, " \t\n");
-        char *argv[100];
-        int argc = 0;
-        while (tokenCommand) {
-            argv[argc++] = tokenCommand;
-            tokenCommand = strtok(NULL, " \t\n");
+        //Commands adding to the history (in case its clear_history/exit , it will be removed, so it's an okay behavior)
+        history_add(command);
+
+        //Tokenizing & Splitting the command (also finds the & at the end, see tokenizer.h).
+        if (tokenize(&line, command) < 0) {
+            continue;
+        }
+        //"time command" - its times are printed once it ends (see stats.h).
+        bool timed = false;
+        if (line.count > 1 && !line.operators[0] && strcmp(line.words[0], "time") == 0) {
+            shift_words(&line);
+            timed = true;
         }
-        argv[argc] = NULL;
+        char **argv = line.words;
+        bool isBackground = line.background;
         //Empty command
         if (!argv[0]) {
             continue;
         }
         //note - tokenizing before checking for commands, since we can have cases such as "   history12" , etc... which is ok.
 
+        if (batch) {
+            if (!is_builtin(argv[0])) {
+                batch_run(&line, history_last(), timed, strategy);
+                continue;
+            }
+            batch_flush(true); //Builtins wait for everything before them ("wait" is there just for that).
+        }
+
         if (strncmp(argv[0], "exit", 4) == 0) { //Exit called
-            free_list(history_list);
-            history_list = NULL;
+            history_clear();
             break;
         }
         if (strncmp(argv[0], "clear_history", 13) == 0) { //Clear_History
-            free_list(history_list);
-            history_list = NULL;
-            counter = 0;
+            history_clear();
             continue;
         } else if (strncmp(argv[0], "history", 7) == 0) { //History - it also should prints itself.
-            print_list(history_list, counter);
+            history_print(stdout);
+            continue;
+        } else if (strncmp(argv[0], "spawn_bench", 11) == 0) {
+            spawn_bench(argv);
+            continue;
+        } else if (strcmp(argv[0], "jobs") == 0) {
+            jobs_list();
+            continue;
+        } else if (strcmp(argv[0], "wait") == 0) {
+            jobs_wait(job_argument(argv, -1));
+            continue;
+        } else if (strcmp(argv[0], "fg") == 0) {
+            jobs_fg(job_argument(argv, 0));
+            continue;
+        } else if (strcmp(argv[0], "hash") == 0) {
+            hash_builtin(argv);
+            continue;
+        } else if (strcmp(argv[0], "stats") == 0) {
+            stats_builtin(argv);
             continue;
         }
 
 
-        pid_t pid = fork();
-        //We get -1 - which means the fork failed
-        if (pid < 0) {
-            perror("error");
-//            exit(1)
-        } else if (pid == 0) {
-            //Son process
-            int status = 0;
-            status = execvp(argv[0], argv);
-            if (status < 0) { //execvp failed, error...
-                perror("error");
-                exit(1);
-            }
-        } else {
-            //Father process (pid >0)
-            if (!isBackground) {
-                int status;
-                //we wait for the son process to complete
-                waitpid(pid, &status, 0);
-            }
+        int stageCount = parse_pipeline(argv, line.operators, line.stages);
+        if (stageCount > 0) {
+            job *job = jobs_start(history_last(), line.stages[0].argv[0], stageCount, isBackground);
+            job->timed = timed;
+            run_pipeline(line.stages, stageCount, strategy, job);
+            jobs_started(job); //waits for it if it is not in the background.
         }
 
     }
 
+    if (batch) {
+        batch_flush(true);
+    }
     return 0;
 }
@@ -0,0 +1,101 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "name_table.h"
+
+static size_t hash_name(const char *name) {
+    //FNV-1a
+    size_t hash = 2166136261u;
+    for (; *name; name++) {
+        hash = (hash ^ (unsigned char) *name) * 16777619u;
+    }
+    return hash;
+}
+
+static void grow(name_table *table) {
+    size_t newCount = table->bucketCount ? table->bucketCount * 2 : NAME_TABLE_BUCKETS;
+    name_entry **newBuckets = calloc(newCount, sizeof(name_entry *));
+    if (!newBuckets) {
+        perror("error");
+        exit(1);
+    }
+    size_t i;
+    for (i = 0; i < table->bucketCount; i++) {
+        while (table->buckets[i]) {
+            name_entry *entry = table->buckets[i];
+            table->buckets[i] = entry->next;
+            size_t index = hash_name(entry->name) & (newCount - 1);
+            entry->next = newBuckets[index];
+            newBuckets[index] = entry;
+        }
+    }
+    free(table->buckets);
+    table->buckets = newBuckets;
+    table->bucketCount = newCount;
+}
+
+name_entry *name_table_find(const name_table *table, const char *name) {
+    if (table->bucketCount == 0) {
+        return NULL;
+    }
+    name_entry *entry;
+    for (entry = table->buckets[hash_name(name) & (table->bucketCount - 1)]; entry; entry = entry->next) {
+        if (strcmp(entry->name, name) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+name_entry *name_table_add(name_table *table, const char *name, size_t entrySize) {
+    if (table->count >= table->bucketCount) {
+        grow(table);
+    }
+    name_entry *entry = calloc(1, entrySize);
+    if (!entry || !(entry->name = strdup(name))) {
+        perror("error");
+        exit(1);
+    }
+    size_t index = hash_name(name) & (table->bucketCount - 1);
+    entry->next = table->buckets[index];
+    table->buckets[index] = entry;
+    table->count++;
+    return entry;
+}
+
+name_entry *name_table_remove(name_table *table, const char *name) {
+    if (table->bucketCount == 0) {
+        return NULL;
+    }
+    name_entry **link = &table->buckets[hash_name(name) & (table->bucketCount - 1)];
+    for (; *link; link = &(*link)->next) {
+        if (strcmp((*link)->name, name) == 0) {
+            name_entry *entry = *link;
+            *link = entry->next;
+            table->count--;
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+void name_table_free(name_entry *entry) {
+    free(entry->name);
+    free(entry);
+}
+
+void name_table_clear(name_table *table, void (*destroy)(name_entry *entry)) {
+    size_t i;
+    for (i = 0; i < table->bucketCount; i++) {
+        while (table->buckets[i]) {
+            name_entry *entry = table->buckets[i];
+            table->buckets[i] = entry->next;
+            if (destroy) {
+                destroy(entry);
+            }
+            name_table_free(entry);
+        }
+    }
+    table->count = 0;
+}
@@ -0,0 +1,49 @@
+#ifndef _NAME_TABLE_H_
+#define _NAME_TABLE_H_
+
+#include <stddef.h>
+
+//Hash table of entries by name (chained, FNV-1a), for the command hash and the stats.
+//An entry is a struct of the caller that starts with a name_entry - the table allocates it (zeroed) and owns
+//its name. The table starts with NAME_TABLE_BUCKETS buckets, and doubles when there are more entries than buckets.
+
+#define NAME_TABLE_BUCKETS 64
+
+typedef struct name_entry name_entry;
+
+struct name_entry {
+    char *name;
+    name_entry *next; //next entry in the same bucket.
+};
+
+//All zeros is an empty table.
+typedef struct {
+    name_entry **buckets;
+    size_t bucketCount;
+    size_t count;
+} name_table;
+
+name_entry *name_table_find(const name_table *table, const char *name);
+
+/**
+ * Adds an entry for a name that is not in the table yet.
+ * @param entrySize - the size of the caller's struct.
+ * @return the new entry, zeroed except for its name.
+ */
+name_entry *name_table_add(name_table *table, const char *name, size_t entrySize);
+
+/**
+ * @return the entry with that name, taken out of the table (free it with name_table_free), NULL if there is none.
+ */
+name_entry *name_table_remove(name_table *table, const char *name);
+
+//Frees the name and the entry, what else the entry points to is the caller's.
+void name_table_free(name_entry *entry);
+
+/**
+ * Empties the table (the buckets stay).
+ * @param destroy - called for every entry before name_table_free, NULL for nothing.
+ */
+void name_table_clear(name_table *table, void (*destroy)(name_entry *entry));
+
+#endif
@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "name_table.h"
+#include "path_cache.h"
+
+typedef struct {
+    name_entry entry; //the command name.
+    char *path;
+    unsigned long hits;
+} path_entry;
+
+static name_table table;
+static char *cachedPath = NULL; //PATH the table was built with.
+
+static void *allocate(size_t size) {
+    void *memory = calloc(1, size);
+    if (!memory) {
+        perror("error");
+        exit(1);
+    }
+    return memory;
+}
+
+static char *copy_string(const char *string) {
+    char *copy = strdup(string);
+    if (!copy) {
+        perror("error");
+        exit(1);
+    }
+    return copy;
+}
+
+static void destroy_entry(name_entry *entry) {
+    free(((path_entry *) entry)->path);
+}
+
+void path_cache_clear(void) {
+    name_table_clear(&table, destroy_entry);
+}
+
+static void check_path(void) {
+    //The table is only good for the PATH it was built with.
+    const char *path = getenv("PATH");
+    if (!path) {
+        path = "/bin:/usr/bin"; //what execvp uses without PATH.
+    }
+    if (cachedPath && strcmp(cachedPath, path) == 0) {
+        return;
+    }
+    path_cache_clear();
+    free(cachedPath);
+    cachedPath = copy_string(path);
+}
+
+static char *search_path(const char *name) {
+    //The same search execvp does, an empty entry of PATH is the current directory.
+    size_t nameLength = strlen(name);
+    const char *dir = cachedPath;
+    char *candidate = allocate(strlen(cachedPath) + nameLength + 3);
+    while (1) {
+        const char *end = strchr(dir, ':');
+        size_t dirLength = end ? (size_t) (end - dir) : strlen(dir);
+        if (dirLength) {
+            memcpy(candidate, dir, dirLength);
+            candidate[dirLength] = '/';
+            memcpy(candidate + dirLength + 1, name, nameLength + 1);
+        } else {
+            memcpy(candidate, name, nameLength + 1);
+        }
+        struct stat fileStat;
+        if (stat(candidate, &fileStat) == 0 && S_ISREG(fileStat.st_mode) && access(candidate, X_OK) == 0) {
+            return candidate;
+        }
+        if (!end) {
+            break;
+        }
+        dir = end + 1;
+    }
+    free(candidate);
+    return NULL;
+}
+
+const char *path_cache_lookup(const char *name) {
+    if (strchr(name, '/')) { //A path, nothing to search.
+        return name;
+    }
+    check_path();
+    path_entry *entry = (path_entry *) name_table_find(&table, name);
+    if (entry) {
+        entry->hits++;
+        return entry->path;
+    }
+
+    char *path = search_path(name);
+    if (!path) {
+        errno = ENOENT;
+        return NULL;
+    }
+    entry = (path_entry *) name_table_add(&table, name, sizeof(path_entry));
+    entry->path = path;
+    entry->hits = 1;
+    return path;
+}
+
+void path_cache_forget(const char *name) {
+    name_entry *entry = name_table_remove(&table, name);
+    if (entry) {
+        destroy_entry(entry);
+        name_table_free(entry);
+    }
+}
+
+void path_cache_print(FILE *out) {
+    check_path();
+    if (table.count == 0) {
+        fprintf(out, "hash: hash table empty\n");
+        return;
+    }
+    fprintf(out, "hits\tcommand\n");
+    size_t i;
+    for (i = 0; i < table.bucketCount; i++) {
+        name_entry *entry;
+        for (entry = table.buckets[i]; entry; entry = entry->next) {
+            fprintf(out, "%4lu\t%s\n", ((path_entry *) entry)->hits, ((path_entry *) entry)->path);
+        }
+    }
+}
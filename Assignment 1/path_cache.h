@@ -0,0 +1,22 @@
+#ifndef _PATH_CACHE_H_
+#define _PATH_CACHE_H_
+
+#include <stdio.h>
+
+//Command hash (like "hash" in bash) - where in PATH every command name is, so we exec the right file
+//right away instead of execvp trying every PATH directory on every command.
+//The table is emptied when PATH changes, and a name is forgotten when its file is gone (ENOENT).
+
+/**
+ * @return the file to exec for the command (name itself if it has a '/'), NULL with errno ENOENT if it is
+ * not in PATH. The string is ours, and valid until the table changes.
+ */
+const char *path_cache_lookup(const char *name);
+
+void path_cache_forget(const char *name);
+void path_cache_clear(void);
+
+//hits and path of every command we know, for the hash builtin.
+void path_cache_print(FILE *out);
+
+#endif
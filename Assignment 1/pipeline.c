@@ -0,0 +1,261 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "launch.h"
+#include "pipeline.h"
+
+#define COPY_CHUNK (1 << 16) //bytes we ask splice/copy_file_range for at once.
+
+int parse_pipeline(char *tokens[], const bool operators[], stage stages[]) {
+    int count = 0;
+    int read = 0;
+    int write = 0; //tokens we keep are moved back to here, every stage ends with a NULL instead of its "|".
+    stage *current = NULL;
+    while (1) {
+        char *token = tokens[read];
+        if (!current) {
+            current = &stages[count++];
+            current->argv = &tokens[write];
+            current->input = NULL;
+            current->output = NULL;
+            current->append = false;
+        }
+        if (!token || (operators[read] && token[0] == '|')) {
+            if (current->argv == &tokens[write]) { //A stage without a command ("| wc", "ls |", "ls | | wc").
+                fprintf(stdout, "error: empty command in pipeline\n");
+                return -1;
+            }
+            tokens[write++] = NULL;
+            if (!token) {
+                return count;
+            }
+            current = NULL;
+            read++;
+            continue;
+        }
+
+        if (operators[read]) { //<, > or >>, the file is the next word.
+            char *file = tokens[read + 1];
+            if (!file || operators[read + 1]) {
+                fprintf(stdout, "error: missing file name after %s\n", token);
+                return -1;
+            }
+            if (token[0] == '<') {
+                current->input = file;
+            } else {
+                current->output = file;
+                current->append = token[1] == '>';
+            }
+            read += 2;
+            continue;
+        }
+        tokens[write++] = tokens[read++];
+    }
+}
+
+static bool is_copy_stage(stage *stage) {
+    //"cat a b" / "cat < a", without any options - the only thing it does is moving the files on.
+    if (strcmp(stage->argv[0], "cat") != 0 || (!stage->argv[1] && !stage->input)) {
+        return false;
+    }
+    int i;
+    for (i = 1; stage->argv[i]; i++) {
+        if (stage->argv[i][0] == '-') {
+            return false;
+        }
+    }
+    return !(stage->argv[1] && stage->input); //cat ignores its stdin when it has files.
+}
+
+int copy_fd(int in, int out) {
+    //The kernel moves the pages: splice when out is a pipe, copy_file_range between files,
+    //read/write only if the files support neither.
+    struct stat outStat;
+    bool outIsPipe = fstat(out, &outStat) == 0 && S_ISFIFO(outStat.st_mode);
+    bool append = (fcntl(out, F_GETFL) & O_APPEND) != 0; //copy_file_range doesn't write to O_APPEND files (">>").
+    ssize_t moved = -1;
+    errno = EINVAL;
+    if (outIsPipe || !append) {
+        do {
+            if (outIsPipe) {
+                moved = splice(in, NULL, out, NULL, COPY_CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE);
+            } else {
+                moved = copy_file_range(in, NULL, out, NULL, COPY_CHUNK, 0);
+            }
+        } while (moved > 0);
+    }
+    if (moved == 0) {
+        return 0;
+    }
+    if (errno != EINVAL && errno != EXDEV && errno != ENOSYS && errno != EOPNOTSUPP) {
+        return -1;
+    }
+
+    char buffer[COPY_CHUNK];
+    while ((moved = read(in, buffer, sizeof(buffer))) > 0) {
+        char *from = buffer;
+        while (moved > 0) {
+            ssize_t written = write(out, from, (size_t) moved);
+            if (written < 0) {
+                return -1;
+            }
+            from += written;
+            moved -= written;
+        }
+    }
+    return moved < 0 ? -1 : 0;
+}
+
+static void copy_stage(stage *stage, int in, int out) {
+    //The reader may exit before it read everything (cat big | head), we want EPIPE and not to die from SIGPIPE.
+    struct sigaction ignore;
+    struct sigaction old;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &old);
+
+    if (!stage->argv[1]) {
+        if (copy_fd(in, out) < 0 && errno != EPIPE) {
+            perror("error");
+        }
+    }
+    int i;
+    for (i = 1; stage->argv[i]; i++) {
+        int fd = open(stage->argv[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror("error");
+            continue;
+        }
+        int result = copy_fd(fd, out);
+        close(fd);
+        if (result < 0) {
+            if (errno != EPIPE) {
+                perror("error");
+            }
+            break;
+        }
+    }
+    sigaction(SIGPIPE, &old, NULL);
+}
+
+static int open_redirection(stage *stage, bool input) {
+    int fd;
+    if (input) {
+        fd = open(stage->input, O_RDONLY | O_CLOEXEC);
+    } else {
+        fd = open(stage->output, O_WRONLY | O_CREAT | O_CLOEXEC | (stage->append ? O_APPEND : O_TRUNC), 0644);
+    }
+    if (fd < 0) {
+        perror("error");
+    }
+    return fd;
+}
+
+void run_pipeline(stage stages[], int count, int strategy, job *job) {
+    //Job control (own process group, the terminal goes to the foreground pipeline) only with a terminal,
+    //like every shell when it runs a script.
+    bool jobControl = jobs_control();
+    bool background = job->background;
+    pid_t *pids = job->pids;
+    pid_t pgid = 0;
+    int copyIn = -1;
+    int copyOut = -1;
+    int nextIn = -1; //read end of the pipe from the previous stage.
+
+    int i;
+    for (i = 0; i < count; i++) {
+        pids[i] = -1;
+        int in = nextIn;
+        int out = -1;
+        nextIn = -1;
+        bool failed = false;
+        if (stages[i].input) {
+            if (in >= 0) {
+                close(in);
+            }
+            in = open_redirection(&stages[i], true);
+            failed = in < 0;
+        }
+        if (i < count - 1) {
+            int fds[2];
+            if (pipe2(fds, O_CLOEXEC) < 0) {
+                perror("error");
+                failed = true;
+            } else {
+                out = fds[1];
+                nextIn = fds[0];
+            }
+        }
+        if (stages[i].output && !failed) {
+            if (out >= 0) {
+                close(out); //the next stage gets an empty pipe.
+            }
+            out = open_redirection(&stages[i], false);
+            failed = out < 0;
+        }
+
+        if (!failed && i == 0 && out >= 0 && is_copy_stage(&stages[i])) {
+            copyIn = in; //done by the shell after all the other stages started.
+            copyOut = out;
+            continue;
+        }
+        if (!failed) {
+            launch_options options;
+            options.in = in;
+            options.out = out;
+            options.pgid = jobControl ? pgid : -1;
+            pids[i] = launch_command(strategy, stages[i].argv, &options);
+            if (pids[i] < 0) {
+                perror("error");
+            } else if (jobControl && pgid == 0) {
+                pgid = pids[i];
+                if (!background) {
+                    jobs_give_terminal(pgid);
+                }
+            }
+        }
+        if (in >= 0) {
+            close(in);
+        }
+        if (out >= 0) {
+            close(out);
+        }
+    }
+
+    if (copyOut >= 0) {
+        if (background) {
+            pid_t pid = fork(); //the shell can't wait for the readers, a child of ours does the copy.
+            if (pid == 0) {
+                if (jobControl) {
+                    setpgid(0, pgid);
+                }
+                copy_stage(&stages[0], copyIn, copyOut);
+                _exit(0);
+            }
+            if (pid > 0 && jobControl) {
+                setpgid(pid, pgid);
+            }
+            pids[0] = pid > 0 ? pid : 0;
+        } else {
+            copy_stage(&stages[0], copyIn, copyOut);
+        }
+        if (copyIn >= 0) {
+            close(copyIn);
+        }
+        close(copyOut);
+    }
+
+    job->pgid = pgid;
+    for (i = 0; i < count; i++) {
+        if (pids[i] < 0) {
+            pids[i] = 0;
+        }
+        job->alive += pids[i] > 0;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "jobs.h"
+
+//cmd1 < in | cmd2 | cmd3 > out (or >> out) - the stages of one command line.
+//All the stages run at the same time, when the shell has a terminal they also share a process group of their own
+//(so ctrl-c goes to the pipeline and not to the shell).
+
+typedef struct {
+    char **argv; //NULL terminated, points into the tokens of the command line.
+    char *input; //file of "<", NULL if there is none.
+    char *output; //file of ">" or ">>", NULL if there is none.
+    bool append; //">>"
+} stage;
+
+/**
+ * Splits the tokens of a command line into stages, in place ("|" and the redirections are taken out of the tokens).
+ * @param operators - which tokens are operators (not quoted), see tokenizer.h.
+ * @param stages - room for one stage for every token.
+ * @return how many stages there are, -1 (after printing an error) if the line is not a valid pipeline.
+ */
+int parse_pipeline(char *tokens[], const bool operators[], stage stages[]);
+
+/**
+ * Starts all the stages, their pids go to the job (the caller waits for it with jobs_started).
+ * A first stage "cat file..." that writes into a pipe or a file is done by the shell itself with
+ * splice/copy_file_range, the data never goes through a buffer of ours.
+ */
+void run_pipeline(stage stages[], int count, int strategy, job *job);
+
+/**
+ * Moves everything from in to out in the kernel (splice into a pipe, copy_file_range otherwise),
+ * with read/write only if the fds support neither.
+ * @return 0, -1 with errno set on an error.
+ */
+int copy_fd(int in, int out);
+
+#endif
@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "name_table.h"
+#include "stats.h"
+
+#define STATS_HISTOGRAM 32 //bucket i has the wall times in [2^i, 2^(i+1)) microseconds, the last one is the rest.
+#define STATS_BAR 40 //chars of the longest bar in the histogram.
+
+typedef struct stats_entry stats_entry;
+
+struct stats_entry {
+    name_entry entry; //the command name.
+    unsigned long runs;
+    long long real; //all in microseconds.
+    long long maxReal;
+    long long user;
+    long long sys;
+    long maxRss; //KB
+    long long switches;
+    unsigned long histogram[STATS_HISTOGRAM];
+    stats_entry *later; //the next name we saw, stats_print goes in this order.
+};
+
+static name_table table;
+static stats_entry *firstEntry = NULL;
+static stats_entry *lastEntry = NULL;
+static FILE *logFile = NULL;
+
+void stats_init(const char *file) {
+    if (!file) {
+        return;
+    }
+    logFile = fopen(file, "a");
+    struct stat fileStat;
+    if (!logFile || fstat(fileno(logFile), &fileStat) < 0) {
+        perror("error");
+        exit(1);
+    }
+    setvbuf(logFile, NULL, _IOLBF, 0); //a line as soon as the job ends, so a crash or a kill doesn't lose them.
+    if (fileStat.st_size == 0) {
+        fprintf(logFile, "serial\tname\tstatus\treal_us\tuser_us\tsys_us\tmaxrss_kb\tvoluntary_cs\tinvoluntary_cs\tcommand\n");
+    }
+}
+
+static stats_entry *find_entry(const char *name, bool add) {
+    stats_entry *entry = (stats_entry *) name_table_find(&table, name);
+    if (entry || !add) {
+        return entry;
+    }
+    entry = (stats_entry *) name_table_add(&table, name, sizeof(stats_entry));
+    if (lastEntry) {
+        lastEntry->later = entry;
+    } else {
+        firstEntry = entry;
+    }
+    lastEntry = entry;
+    return entry;
+}
+
+static long long micros(const struct timeval *time) {
+    return (long long) time->tv_sec * 1000000 + time->tv_usec;
+}
+
+static int histogram_bucket(long long real) {
+    int bucket = 0;
+    while (real >= 2 && bucket < STATS_HISTOGRAM - 1) {
+        real >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+static int exit_code(int status) {
+    //As $? in sh.
+    if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 0;
+}
+
+static void print_time(const char *label, long long time) {
+    fprintf(stdout, "%s\t%lldm%lld.%03llds\n", label, time / 60000000, time / 1000000 % 60, time / 1000 % 1000);
+}
+
+void stats_record(const job *job) {
+    long long real = (long long) (job->ended.tv_sec - job->started.tv_sec) * 1000000 +
+                     (job->ended.tv_nsec - job->started.tv_nsec) / 1000;
+    long long user = micros(&job->usage.ru_utime);
+    long long sys = micros(&job->usage.ru_stime);
+    long long switches = job->usage.ru_nvcsw + job->usage.ru_nivcsw;
+
+    stats_entry *entry = find_entry(job->name, true);
+    entry->runs++;
+    entry->real += real;
+    if (real > entry->maxReal) {
+        entry->maxReal = real;
+    }
+    entry->user += user;
+    entry->sys += sys;
+    if (job->usage.ru_maxrss > entry->maxRss) {
+        entry->maxRss = job->usage.ru_maxrss;
+    }
+    entry->switches += switches;
+    entry->histogram[histogram_bucket(real)]++;
+
+    if (job->timed) {
+        print_time("real", real);
+        print_time("user", user);
+        print_time("sys", sys);
+        fprintf(stdout, "maxrss\t%ldk\n", job->usage.ru_maxrss);
+        fprintf(stdout, "csw\t%ld voluntary, %ld involuntary\n", job->usage.ru_nvcsw, job->usage.ru_nivcsw);
+    }
+    if (logFile) {
+        fprintf(logFile, "%lu\t%s\t%d\t%lld\t%lld\t%lld\t%ld\t%ld\t%ld\t%s\n", job->serial, job->name,
+                exit_code(job->status), real, user, sys, job->usage.ru_maxrss, job->usage.ru_nvcsw,
+                job->usage.ru_nivcsw, job->command);
+    }
+}
+
+static const char *format_duration(char *buffer, size_t size, long long time) {
+    if (time < 1000) {
+        snprintf(buffer, size, "%lldus", time);
+    } else if (time < 1000000) {
+        snprintf(buffer, size, "%.1fms", time / 1e3);
+    } else {
+        snprintf(buffer, size, "%.1fs", time / 1e6);
+    }
+    return buffer;
+}
+
+static void print_entry(FILE *out, const stats_entry *entry) {
+    char average[16];
+    char longest[16];
+    char user[16];
+    char sys[16];
+    fprintf(out, "%s: %lu runs, real avg %s max %s, user %s, sys %s, max rss %ldk, %lld context switches\n",
+            entry->entry.name, entry->runs,
+            format_duration(average, sizeof(average), entry->real / (long long) entry->runs),
+            format_duration(longest, sizeof(longest), entry->maxReal),
+            format_duration(user, sizeof(user), entry->user), format_duration(sys, sizeof(sys), entry->sys),
+            entry->maxRss, entry->switches);
+
+    //Only the buckets from the first to the last one that has runs.
+    int low = 0;
+    int high = STATS_HISTOGRAM - 1;
+    unsigned long most = 0;
+    int i;
+    while (!entry->histogram[low]) {
+        low++;
+    }
+    while (!entry->histogram[high]) {
+        high--;
+    }
+    for (i = low; i <= high; i++) {
+        if (entry->histogram[i] > most) {
+            most = entry->histogram[i];
+        }
+    }
+    for (i = low; i <= high; i++) {
+        char from[16];
+        char to[16];
+        format_duration(from, sizeof(from), i ? 1LL << i : 0);
+        if (i == STATS_HISTOGRAM - 1) {
+            snprintf(to, sizeof(to), "...");
+        } else {
+            format_duration(to, sizeof(to), 1LL << (i + 1));
+        }
+        int bar = (int) ((entry->histogram[i] * STATS_BAR + most - 1) / most);
+        fprintf(out, "  %8s - %-8s |%-*.*s| %lu\n", from, to, STATS_BAR, bar,
+                "########################################", entry->histogram[i]);
+    }
+}
+
+bool stats_print(FILE *out, const char *name) {
+    if (name) {
+        stats_entry *entry = find_entry(name, false);
+        if (entry) {
+            print_entry(out, entry);
+        }
+        return entry != NULL;
+    }
+    stats_entry *entry;
+    for (entry = firstEntry; entry; entry = entry->later) {
+        print_entry(out, entry);
+    }
+    return firstEntry != NULL;
+}
+
+void stats_clear(void) {
+    name_table_clear(&table, NULL);
+    firstEntry = NULL;
+    lastEntry = NULL;
+}
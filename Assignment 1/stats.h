@@ -0,0 +1,30 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "jobs.h"
+
+//Where the time goes - every job that ends is counted under the name of its command (the first stage):
+//runs, wall time (from the start to the last reaped process), user/sys CPU, max rss and context switches,
+//and a histogram of the wall times (powers of 2, from 1us). The stats builtin prints them.
+//With a log file every job is also a line there (tab separated, the columns are in its first line).
+//"time command" prints the same for one command once it ends (in batch mode - when it ends, not in order).
+
+/**
+ * @param logFile - appended to, NULL for none.
+ */
+void stats_init(const char *logFile);
+
+//A job ended (called by the job table, SIGCHLD is blocked).
+void stats_record(const job *job);
+
+/**
+ * For the stats builtin.
+ * @param name - the command to print, NULL for all of them.
+ * @return false if there are no stats for it.
+ */
+bool stats_print(FILE *out, const char *name);
+void stats_clear(void);
+
+#endif
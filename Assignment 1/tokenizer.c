@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tokenizer.h"
+
+static void *grow(void *memory, size_t size) {
+    memory = realloc(memory, size);
+    if (!memory) {
+        perror("error");
+        exit(1);
+    }
+    return memory;
+}
+
+static void reserve_words(command_line *line) {
+    //One more for the NULL at the end.
+    if (line->count + 1 < line->capacity) {
+        return;
+    }
+    line->capacity = line->capacity ? line->capacity * 2 : 64;
+    line->words = grow(line->words, line->capacity * sizeof(char *));
+    line->operators = grow(line->operators, line->capacity * sizeof(bool));
+    line->stages = grow(line->stages, line->capacity * sizeof(stage));
+}
+
+static void add_word(command_line *line, char *word, bool operator) {
+    reserve_words(line);
+    line->words[line->count] = word;
+    line->operators[line->count] = operator;
+    line->count++;
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+static bool is_operator(char c) {
+    return c == '|' || c == '<' || c == '>';
+}
+
+static bool only_spaces(const char *text) {
+    while (is_space(*text)) {
+        text++;
+    }
+    return !*text;
+}
+
+int tokenize(command_line *line, const char *text) {
+    //Every char of the line is at most one char of a word, and a NUL after it ("a|b" is "a\0|\0b\0"),
+    //so the arena never has to move while we fill it and the words can point into it.
+    size_t needed = 2 * strlen(text) + 1;
+    if (needed > line->textSize) {
+        line->textSize = needed > 2 * line->textSize ? needed : 2 * line->textSize;
+        line->text = grow(line->text, line->textSize);
+    }
+    line->count = 0;
+    line->background = false;
+    reserve_words(line);
+
+    char *out = line->text;
+    const char *in = text;
+    while (1) {
+        while (is_space(*in)) {
+            in++;
+        }
+        if (!*in) {
+            break;
+        }
+        if (is_operator(*in)) {
+            add_word(line, out, true);
+            *out++ = *in;
+            if (in[0] == '>' && in[1] == '>') {
+                *out++ = *++in;
+            }
+            in++;
+            *out++ = '\0';
+            continue;
+        }
+        if (*in == '&' && only_spaces(in + 1)) {
+            line->background = true;
+            break;
+        }
+
+        add_word(line, out, false);
+        char quote = 0; //the quote we are in, 0 outside of quotes.
+        while (*in) {
+            char c = *in;
+            if (quote == '\'') {
+                if (c == '\'') {
+                    quote = 0;
+                } else {
+                    *out++ = c;
+                }
+            } else if (quote == '"') {
+                if (c == '"') {
+                    quote = 0;
+                } else if (c == '\\' && (in[1] == '"' || in[1] == '\\')) {
+                    *out++ = *++in;
+                } else {
+                    *out++ = c;
+                }
+            } else if (is_space(c) || is_operator(c) || (c == '&' && only_spaces(in + 1))) {
+                break; //the end of the word.
+            } else if (c == '\'' || c == '"') {
+                quote = c;
+            } else if (c == '\\' && in[1]) {
+                *out++ = *++in;
+            } else {
+                *out++ = c;
+            }
+            in++;
+        }
+        if (quote) {
+            fprintf(stdout, "error: unterminated %c\n", quote);
+            line->count = 0;
+            line->words[0] = NULL;
+            return -1;
+        }
+        *out++ = '\0';
+    }
+    line->words[line->count] = NULL;
+    return line->count;
+}
+
+void shift_words(command_line *line) {
+    if (line->count == 0) {
+        return;
+    }
+    line->count--;
+    memmove(line->words, line->words + 1, (line->count + 1) * sizeof(char *)); //with the NULL.
+    memmove(line->operators, line->operators + 1, line->count * sizeof(bool));
+}
@@ -0,0 +1,38 @@
+#ifndef _TOKENIZER_H_
+#define _TOKENIZER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "pipeline.h"
+
+//Splits a command line into words, in one pass and without any limit on the line or on the words.
+//'...' keeps everything as it is, "..." keeps everything but \" and \\, \ outside quotes escapes the next char.
+//Unquoted |, <, > and >> are words of their own even without spaces around them ("a|b" is "a" "|" "b"), and only
+//those are operators - a quoted "|" is just an argument. An unquoted & at the end runs the line in the background.
+//
+//One command_line is used for the whole session, its memory only grows (when a longer line comes), so a command
+//doesn't allocate anything once the shell saw a line as long as it.
+
+typedef struct {
+    char **words; //NULL terminated.
+    bool *operators; //operators[i] - words[i] is an unquoted |, <, > or >>.
+    int count;
+    bool background;
+    stage *stages; //room for one stage for every word, for parse_pipeline.
+
+    //the arena - the text of all the words, one after the other.
+    char *text;
+    size_t textSize;
+    int capacity; //of words, operators and stages.
+} command_line;
+
+/**
+ * @param line - the words of the previous line (if any) are gone.
+ * @return how many words there are, -1 (after printing an error) on an unterminated quote.
+ */
+int tokenize(command_line *line, const char *text);
+
+//Drops the first word (a prefix such as "time").
+void shift_words(command_line *line);
+
+#endif
@@ -0,0 +1,272 @@
+#define _GNU_SOURCE
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "concurrent_list.h"
+#include "list_lock.h"
+
+//Single thread benchmark of the list backend that was linked in (see "make bench LIST=... LOCK=...").
+//-m ops (default): for every size we build a list of even values, then time insert + remove pairs of
+//random odd values (so the list size stays the same), until the time budget or the ops limit runs out.
+//-m traverse: for every size we time full traversals of the list and count the cache misses per node
+//(when the kernel lets us open a perf counter), to see the effect of the node layout.
+//-m batch: for every size we time insert_values + remove_values of random batches (-b values per batch)
+//against a loop of insert_value + remove_value over the same batch.
+//-m build: for every size we time create_list_from_sorted + delete_list of sorted values (a restart that loads
+//a saved list, from BUILD_PARALLEL_MIN values with several threads) against insert_value of the same values in
+//the same order. The loop stops after -t seconds, then we print how far it got - raise -t to see it through.
+
+#ifndef LIST_NAME
+#define LIST_NAME "concurrent_list"
+#endif
+
+#define MIN_SIZE 1000
+#define DEFAULT_MAX_SIZE 10000000
+#define DEFAULT_SECONDS 1.0
+#define MAX_OPS 200000
+#define DEFAULT_BATCH 1000
+
+#define MODE_OPS 0
+#define MODE_TRAVERSE 1
+#define MODE_BATCH 2
+#define MODE_BUILD 3
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static list *build_list(long size) {
+    list *list = create_list();
+    long i;
+    //Inserting from the biggest value down, so a sorted linked list builds in O(n) too.
+    for (i = size - 1; i >= 0; i--) {
+        insert_value(list, (int) (2 * i));
+    }
+    return list;
+}
+
+static int open_cache_miss_counter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0); //-1 in case perf events are not allowed.
+}
+
+static long long read_counter(int fd) {
+    long long count = 0;
+    if (fd < 0 || read(fd, &count, sizeof(count)) != sizeof(count)) {
+        return 0;
+    }
+    return count;
+}
+
+static void bench_ops(long size, double seconds) {
+    double start = now_seconds();
+    list *list = build_list(size);
+    double buildTime = now_seconds() - start;
+
+    unsigned int seed = 1;
+    double insertTime = 0;
+    double removeTime = 0;
+    long ops = 0;
+    double end = now_seconds() + seconds;
+    while (ops < MAX_OPS && now_seconds() < end) {
+        int value = (int) (2 * (rand_r(&seed) % size) + 1);
+        double t0 = now_seconds();
+        insert_value(list, value);
+        double t1 = now_seconds();
+        remove_value(list, value);
+        double t2 = now_seconds();
+        insertTime += t1 - t0;
+        removeTime += t2 - t1;
+        ops++;
+    }
+
+    start = now_seconds();
+    delete_list(list);
+    double deleteTime = now_seconds() - start;
+
+    printf("%10ld %14.0f %14.0f %12.1f %12.1f %10ld\n", size, insertTime / ops * 1e9, removeTime / ops * 1e9,
+           buildTime * 1e3, deleteTime * 1e3, ops);
+}
+
+static void bench_traverse(long size, double seconds, int counterFd) {
+    list *list = build_list(size);
+    //Removing a value bigger than every value walks the whole list and removes nothing.
+    int missing = (int) (2 * size + 1);
+    remove_value(list, missing); //warm up
+
+    long traversals = 0;
+    long long misses = read_counter(counterFd);
+    double start = now_seconds();
+    double elapsed = 0;
+    while (traversals < MAX_OPS && elapsed < seconds) {
+        remove_value(list, missing);
+        traversals++;
+        elapsed = now_seconds() - start;
+    }
+    misses = read_counter(counterFd) - misses;
+    delete_list(list);
+
+    double nodes = (double) traversals * size;
+    if (counterFd >= 0) {
+        printf("%10ld %14.2f %16.3f %12ld\n", size, elapsed / nodes * 1e9, misses / nodes, traversals);
+    } else {
+        printf("%10ld %14.2f %16s %12ld\n", size, elapsed / nodes * 1e9, "n/a", traversals);
+    }
+}
+
+static void bench_batch(long size, double seconds, int batchSize) {
+    list *list = build_list(size);
+    int *batch = (int *) malloc(batchSize * sizeof(int));
+    if (!batch) {
+        perror("error");
+        exit(1);
+    }
+
+    unsigned int seed = 1;
+    double batchTime = 0;
+    double loopTime = 0;
+    long rounds = 0;
+    double end = now_seconds() + seconds;
+    while (rounds < MAX_OPS && now_seconds() < end) {
+        int i;
+        for (i = 0; i < batchSize; i++) {
+            batch[i] = (int) (2 * (rand_r(&seed) % size) + 1);
+        }
+        double t0 = now_seconds();
+        insert_values(list, batch, batchSize);
+        remove_values(list, batch, batchSize);
+        double t1 = now_seconds();
+        for (i = 0; i < batchSize; i++) {
+            insert_value(list, batch[i]);
+        }
+        for (i = 0; i < batchSize; i++) {
+            remove_value(list, batch[i]);
+        }
+        double t2 = now_seconds();
+        batchTime += t1 - t0;
+        loopTime += t2 - t1;
+        rounds++;
+    }
+    delete_list(list);
+    free(batch);
+
+    double values = (double) rounds * batchSize;
+    printf("%10ld %18.1f %18.1f %10.1fx %10ld\n", size, batchTime / values * 1e9, loopTime / values * 1e9,
+           loopTime / batchTime, rounds);
+}
+
+static void bench_build(long size, double seconds) {
+    int *values = (int *) malloc(size * sizeof(int));
+    if (!values) {
+        perror("error");
+        exit(1);
+    }
+    long i;
+    for (i = 0; i < size; i++) {
+        values[i] = (int) (2 * i);
+    }
+
+    double start = now_seconds();
+    list *list = create_list_from_sorted(values, (size_t) size);
+    double buildTime = now_seconds() - start;
+    start = now_seconds();
+    delete_list(list);
+    double deleteTime = now_seconds() - start;
+
+    list = create_list();
+    start = now_seconds();
+    double elapsed = 0;
+    long done = 0;
+    while (done < size && elapsed < seconds) {
+        insert_value(list, values[done++]);
+        if ((done & 1023) == 0) {
+            elapsed = now_seconds() - start;
+        }
+    }
+    elapsed = now_seconds() - start;
+    delete_list(list);
+    free(values);
+
+    //A loop that didn't finish took more than that, so its speedup is at least that.
+    const char *more = done < size ? ">" : "";
+    printf("%10ld %12.1f %12.1f %1s%13.1f %12ld %1s%10.1fx\n", size, buildTime * 1e3, deleteTime * 1e3, more,
+           elapsed * 1e3, done, more, elapsed / (buildTime + deleteTime));
+}
+
+int main(int argc, char **argv) {
+    long maxSize = DEFAULT_MAX_SIZE;
+    double seconds = DEFAULT_SECONDS;
+    int batchSize = DEFAULT_BATCH;
+    int mode = MODE_OPS;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            maxSize = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            batchSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc && strcmp(argv[i + 1], "ops") == 0) {
+            mode = MODE_OPS;
+            i++;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc && strcmp(argv[i + 1], "traverse") == 0) {
+            mode = MODE_TRAVERSE;
+            i++;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc && strcmp(argv[i + 1], "batch") == 0) {
+            mode = MODE_BATCH;
+            i++;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc && strcmp(argv[i + 1], "build") == 0) {
+            mode = MODE_BUILD;
+            i++;
+        } else {
+            fprintf(stderr, "usage: %s [-m ops|traverse|batch|build] [-n max_size] [-t seconds_per_size] "
+                            "[-b batch_size]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    printf("backend: %s, lock: %s\n", LIST_NAME, LIST_LOCK_NAME);
+    long size;
+    if (mode == MODE_TRAVERSE) {
+        int counterFd = open_cache_miss_counter();
+        printf("%10s %14s %16s %12s\n", "size", "ns/node", "cache-miss/node", "traversals");
+        for (size = MIN_SIZE; size <= maxSize; size *= 10) {
+            bench_traverse(size, seconds, counterFd);
+        }
+        if (counterFd >= 0) {
+            close(counterFd);
+        }
+    } else if (mode == MODE_BATCH) {
+        printf("%10s %18s %18s %11s %10s\n", "size", "batch(ns/value)", "loop(ns/value)", "speedup", "rounds");
+        for (size = MIN_SIZE; size <= maxSize; size *= 10) {
+            bench_batch(size, seconds, batchSize);
+        }
+    } else if (mode == MODE_BUILD) {
+        printf("%10s %12s %12s %14s %12s %11s\n", "size", "build(ms)", "delete(ms)", "insert loop(ms)",
+               "inserted", "speedup");
+        for (size = MIN_SIZE; size <= maxSize; size *= 10) {
+            bench_build(size, seconds);
+        }
+    } else {
+        printf("%10s %14s %14s %12s %12s %10s\n", "size", "insert(ns)", "remove(ns)", "build(ms)", "delete(ms)",
+               "ops");
+        for (size = MIN_SIZE; size <= maxSize; size *= 10) {
+            bench_ops(size, seconds);
+        }
+    }
+    return 0;
+}
@@ -1,20 +1,307 @@
+#define _POSIX_C_SOURCE 200112L
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <limits.h>
+#include <stddef.h>
+#include <unistd.h>
 #include "concurrent_list.h"
+#include "list_lock.h"
+#include "node_pool.h"
+
+//The list can be split by value ranges into LIST_SHARDS sublists (make SHARDS=N), every shard with its own
+//head lock, so operations on different ranges never touch the same head. The shards in order are the list.
+//The ranges start as equal parts of the int range, and when one shard gets much bigger than the others
+//they are moved to the quantiles of the values in the list (rebalance_shards).
+//With the default LIST_SHARDS = 1 it is the plain hand over hand list.
+#ifndef LIST_SHARDS
+#define LIST_SHARDS 1
+#endif
+
+#define BATCH_STACK_SIZE 256 //batches up to this size are sorted on the stack.
+#define READ_TRIES 3 //lock-free tries of a query before it falls back to the node locks.
+#define READ_CHECK_STEPS 64 //a lock-free reader checks the list version every that many nodes.
+#define ITER_TRIES 3 //iterations that weren't a snapshot in a row before the next one takes the whole list.
+#define CACHE_LINE 64
+#define SHARD_PARALLEL_MIN (1 << 14) //count_list and print_list use several threads from this list size.
+#define SHARD_CHECK_INTERVAL 1024 //a shard checks the balance every time its size passes a multiple of this.
+#define SHARD_REBALANCE_FACTOR 2 //rebalance once a shard holds more than this times its fair share.
+#define BUILD_PARALLEL_MIN (1 << 16) //create_list_from_sorted uses several threads from this many values.
+#define BUILD_UNITS_PER_THREAD 4 //pieces of the array per build thread, so a slow thread doesn't hold everybody.
+#define SWAP_MANY_MIN 64 //swap_many takes the whole list from this many pairs, smaller batches are a loop.
 
 struct node {
     int value; //Current node value.
+    list_lock lock; //the lock for the node (the lock policy is selected at build time, see list_lock.h).
     node *next; //pointer to the next node.
-    pthread_mutex_t mutex; //the mutex lock for the node.
 };
 
+typedef struct shard {
+    //Sentinel node before the first value of the shard, its lock is the shard lock and head.next is the
+    //first node (null in case the shard is empty). Its value is never used.
+    node head;
+    long size; //values in the shard, changed under the lock of the changed node (only kept with LIST_SHARDS > 1).
+    long foreign; //values outside the shard range (moved here by swap_values, or out of order when rebalance_shards cut), remove_value looks for them here too.
+    //Seqlock for the readers that take no locks (contains_value, range_count, list_iter):
+    //every change of a value or a link is done between write_begin and write_end, so a reader that sees
+    //writesStarted == writesDone when it begins, and the same writesStarted when it ends, read a snapshot.
+    //Two counters and not one odd/even counter, because several writers can change the list at the same time.
+    unsigned long writesStarted;
+    unsigned long writesDone;
+} __attribute__((aligned(CACHE_LINE))) shard; //every shard in its own cache lines.
+
 struct list {
-    node *nodeList; //The head pointer node of the list, will be null in case the list is empty.
-    pthread_mutex_t mutex; //the mutex lock for the list.
+    shard shards[LIST_SHARDS];
+    //shard i holds the values v with lowerBounds[i] <= v < lowerBounds[i + 1] (long long, so an empty shard
+    //can get a bound that no int reaches). They only change while rebalance_shards holds every head lock.
+    long long lowerBounds[LIST_SHARDS];
+    //How many times values moved between shards (rebalance_shards, or swap_values across shards),
+    //a search that skipped shards and missed retries if it changed.
+    unsigned long moves;
+    int rebalancing; //1 while a thread rebalances the shards.
+    node_pool *pool; //every node of the list comes from this pool, with its lock already initialized.
 };
 
+static void init_node(void *object) {
+    //Called once per node when the pool creates it, the lock stays initialized while the node is reused.
+    node *newNode = (node *) object;
+    if (list_lock_init(&(newNode->lock)) != 0) {
+        perror("error");
+        exit(1);
+    }
+}
+
+static void destroy_node(void *object) {
+    list_lock_destroy(&(((node *) object)->lock));
+}
+
+//The value and the next of a node are read by the lock-free readers at any time (even after the node
+//was freed, see node_pool.h), so they are always written and read with atomic stores/loads.
+static inline void set_value(node *node, int value) {
+    __atomic_store_n(&node->value, value, __ATOMIC_RELAXED);
+}
+
+static inline void set_next(node *node, struct node *next) {
+    __atomic_store_n(&node->next, next, __ATOMIC_RELAXED);
+}
+
+static inline int load_value(node *node) {
+    return __atomic_load_n(&node->value, __ATOMIC_RELAXED);
+}
+
+static inline node *load_next(node *node) {
+    return __atomic_load_n(&node->next, __ATOMIC_RELAXED);
+}
+
+static inline void write_begin(shard *shard) {
+    //The fence keeps our stores to the nodes after the increment (seqlock writer side).
+    __atomic_fetch_add(&shard->writesStarted, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_end(shard *shard) {
+    __atomic_fetch_add(&shard->writesDone, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Starts a lock-free read of the list.
+ * The counters only grow and writesDone <= writesStarted, so the sums are equal only if they are equal
+ * in every shard, and the sum of writesStarted changes as soon as any shard changes.
+ * @param version - the list version to check at the end with read_validate.
+ * @return 0 if a writer is in the middle of a change right now (the read can't be a snapshot).
+ */
+static inline int read_begin(list *list, unsigned long *version) {
+    //writesDone first - if it is equal to writesStarted that we read after it, no write was in the middle.
+    unsigned long done = 0;
+    unsigned long started = 0;
+    int i;
+    for (i = 0; i < LIST_SHARDS; i++) {
+        done += __atomic_load_n(&list->shards[i].writesDone, __ATOMIC_ACQUIRE);
+        started += __atomic_load_n(&list->shards[i].writesStarted, __ATOMIC_ACQUIRE);
+    }
+    *version = started;
+    return started == done;
+}
+
+static inline int read_validate(list *list, unsigned long version) {
+    //The fence keeps our loads from the nodes before the check (seqlock reader side).
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    unsigned long started = 0;
+    int i;
+    for (i = 0; i < LIST_SHARDS; i++) {
+        started += __atomic_load_n(&list->shards[i].writesStarted, __ATOMIC_RELAXED);
+    }
+    return started == version;
+}
+
+static inline int shard_of(list *list, int value) {
+    //Binary search for the last shard with lowerBound <= value (lowerBounds[0] is INT_MIN).
+    int low = 0;
+    int high = LIST_SHARDS - 1;
+    while (low < high) {
+        int mid = (low + high + 1) / 2;
+        if (__atomic_load_n(&list->lowerBounds[mid], __ATOMIC_RELAXED) <= value) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+static inline int is_foreign(list *list, shard *shard, int value) {
+    return &list->shards[shard_of(list, value)] != shard;
+}
+
+static inline int may_hold(list *list, int index, int value) {
+    //Only the shard of the value, or a shard that swap_values moved values into, can hold the value.
+    return index == shard_of(list, value) || __atomic_load_n(&list->shards[index].foreign, __ATOMIC_RELAXED) > 0;
+}
+
+static inline unsigned long load_moves(list *list) {
+    return __atomic_load_n(&list->moves, __ATOMIC_ACQUIRE);
+}
+
+static shard *lock_shard_of(list *list, int value) {
+    //The bounds can't change while we hold a head lock, so after we got it we check it is still the right shard.
+    while (1) {
+        shard *currShard = &list->shards[shard_of(list, value)];
+        list_lock_acquire_head(&(currShard->head.lock));
+        if (!is_foreign(list, currShard, value)) {
+            return currShard;
+        }
+        list_lock_release(&(currShard->head.lock));
+    }
+}
+
+static long lock_all_shards(list *list) {
+    //Takes the whole list for ourselves (rebalance_shards, swap_many), returns how many values it has.
+    //Taking the heads in shard order, and walking every shard to its end right after we got its head,
+    //so every operation that was inside the shard is done, and nobody can get in without the head.
+    //(swap_values holds nodes of one shard while it takes the head of the next one, that is why we walk
+    //shard i before we take the head of shard i + 1.)
+    //The lock-free search of optimistic_swap takes no head at all, so every shard is also in a write from
+    //before we walk it until unlock_all_shards: a swap that locks a node after we passed it fails its version
+    //check, and a swap that locked its nodes before we got to them is done before we pass them.
+    long total = 0;
+    int i;
+    for (i = 0; i < LIST_SHARDS; i++) {
+        shard *currShard = &list->shards[i];
+        list_lock_acquire_head(&(currShard->head.lock));
+        write_begin(currShard);
+        node *prevNode = currShard->head.next;
+        if (prevNode) {
+            list_lock_acquire(&(prevNode->lock));
+            total++;
+            while (prevNode->next) {
+                list_lock_acquire(&(prevNode->next->lock));
+                list_lock_release(&(prevNode->lock));
+                prevNode = prevNode->next;
+                total++;
+            }
+            list_lock_release(&(prevNode->lock));
+        }
+    }
+    return total;
+}
+
+static void unlock_all_shards(list *list) {
+    int i;
+    for (i = LIST_SHARDS - 1; i >= 0; i--) {
+        write_end(&list->shards[i]);
+        list_lock_release(&(list->shards[i].head.lock));
+    }
+}
+
+static void rebalance_shards(list *list) {
+    int expected = 0;
+    if (!__atomic_compare_exchange_n(&list->rebalancing, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return; //Somebody else does it right now.
+    }
+
+    long total = lock_all_shards(list);
+    node *firstNodes[LIST_SHARDS];
+    int i;
+    for (i = 0; i < LIST_SHARDS; i++) {
+        firstNodes[i] = list->shards[i].head.next;
+    }
+
+    if (total > 0) {
+        //The shards one after the other are (mostly) one sorted run, we cut it into LIST_SHARDS parts
+        //of the same size (equal values stay in the same part). swap_values may have left values out of order,
+        //so the bounds are only our best guess and the foreign counts are counted again below.
+        int source = 0;
+        node *currNode = firstNodes[0];
+        long left = total;
+        for (i = 0; i < LIST_SHARDS; i++) {
+            shard *currShard = &list->shards[i];
+            long target = (left + LIST_SHARDS - i - 1) / (LIST_SHARDS - i);
+            long size = 0;
+            node *prevNode = &currShard->head;
+            while (1) {
+                while (!currNode && source < LIST_SHARDS - 1) {
+                    currNode = firstNodes[++source];
+                }
+                if (!currNode || (size >= target && currNode->value != prevNode->value && i < LIST_SHARDS - 1)) {
+                    break;
+                }
+                set_next(prevNode, currNode);
+                prevNode = currNode;
+                currNode = currNode->next;
+                size++;
+            }
+            set_next(prevNode, NULL);
+            currShard->size = size;
+            left -= size;
+            if (i > 0) {
+                //The first value of the part, or a bound no int reaches for the empty parts at the end.
+                long long bound = size > 0 ? (long long) currShard->head.next->value : (long long) INT_MAX + i;
+                if (bound <= list->lowerBounds[i - 1]) {
+                    bound = list->lowerBounds[i - 1] + 1;
+                }
+                __atomic_store_n(&list->lowerBounds[i], bound, __ATOMIC_RELAXED);
+            }
+        }
+        for (i = 0; i < LIST_SHARDS; i++) {
+            shard *currShard = &list->shards[i];
+            long foreign = 0;
+            node *currNode = currShard->head.next;
+            while (currNode) {
+                foreign += is_foreign(list, currShard, currNode->value);
+                currNode = currNode->next;
+            }
+            __atomic_store_n(&currShard->foreign, foreign, __ATOMIC_RELAXED);
+        }
+        __atomic_fetch_add(&list->moves, 1, __ATOMIC_RELEASE);
+    }
+
+    unlock_all_shards(list);
+    __atomic_store_n(&list->rebalancing, 0, __ATOMIC_RELEASE);
+}
+
+static inline long add_size(shard *shard, long change) {
+    if (LIST_SHARDS == 1) {
+        return 0;
+    }
+    return __atomic_add_fetch(&shard->size, change, __ATOMIC_RELAXED);
+}
+
+static void check_balance(list *list, long size, long added) {
+    //Called with no lock held after a shard got added values (size is its size right after that),
+    //every time a shard passes a multiple of SHARD_CHECK_INTERVAL we check if it got much bigger than its fair share.
+    if (LIST_SHARDS == 1 || size / SHARD_CHECK_INTERVAL == (size - added) / SHARD_CHECK_INTERVAL) {
+        return;
+    }
+    long total = 0;
+    int i;
+    for (i = 0; i < LIST_SHARDS; i++) {
+        total += __atomic_load_n(&list->shards[i].size, __ATOMIC_RELAXED);
+    }
+    if (size > SHARD_REBALANCE_FACTOR * total / LIST_SHARDS + SHARD_CHECK_INTERVAL) {
+        rebalance_shards(list);
+    }
+}
+
 void print_node(node *node) {
     // DO NOT DELETE
     if (node) {
@@ -23,191 +310,611 @@ void print_node(node *node) {
 }
 
 list *create_list() {
-    list *newList = (list *) malloc(sizeof(list));
-    if (newList) {
-        newList->nodeList = NULL;
-    } else {
-        //Error with memory allocation (malloc).
+    void *memory;
+    if (posix_memalign(&memory, CACHE_LINE, sizeof(list)) != 0) {
+        //Error with memory allocation.
         perror("error");
         exit(1);
     }
-    int result = pthread_mutex_init(&(newList->mutex), NULL);
-    if (result != 0) { //Unsuccessful mutex initialize (if we get 0, it means we succeeded).
+    list *newList = (list *) memory;
+    int i;
+    for (i = 0; i < LIST_SHARDS; i++) {
+        shard *newShard = &newList->shards[i];
+        newShard->head.value = 0;
+        newShard->head.next = NULL;
+        newShard->size = 0;
+        newShard->foreign = 0;
+        newShard->writesStarted = 0;
+        newShard->writesDone = 0;
+        //Equal parts of the int range to begin with.
+        newList->lowerBounds[i] = INT_MIN + ((long long) UINT_MAX + 1) / LIST_SHARDS * i;
+        int result = list_lock_init(&(newShard->head.lock));
+        if (result != 0) { //Unsuccessful lock initialize (if we get 0, it means we succeeded).
+            while (i-- > 0) {
+                list_lock_destroy(&(newList->shards[i].head.lock));
+            }
+            free(newList);
+            return NULL;
+        }
+    }
+    newList->moves = 0;
+    newList->rebalancing = 0;
+    newList->pool = node_pool_create(sizeof(node), offsetof(node, next), init_node,
+                                     LIST_LOCK_NEEDS_DESTROY ? destroy_node : NULL);
+    if (!newList->pool) {
+        for (i = 0; i < LIST_SHARDS; i++) {
+            list_lock_destroy(&(newList->shards[i].head.lock));
+        }
         free(newList);
         return NULL;
     }
-    return newList;//The mutex and the list were successful
+    return newList;//The lock and the list were successful
 }
 
 void delete_list(list *list) {
     //We will divide this function into 2 sections:
-    //1. Delete the list itself, but we keep the node list.
-    //2. Delete the inner node list.
-
-    node *nodeList;
-    node *deleteNode;
+    //1. Detach the node list from the list.
+    //2. Delete the nodes - every node lives in the list pool, so we release the whole pool at once
+    //   instead of freeing the node list one by one.
 
     if (!list) { //List is already NULL, nothing to delete.
         return;
     }
 
-    pthread_mutex_lock(&list->mutex);
-    nodeList = list->nodeList;
-    list->nodeList = NULL;
-    pthread_mutex_unlock(&list->mutex);
-    pthread_mutex_destroy(&(list->mutex));
+    int i;
+    for (i = 0; i < LIST_SHARDS; i++) {
+        shard *currShard = &list->shards[i];
+        list_lock_acquire_head(&(currShard->head.lock));
+        currShard->head.next = NULL;
+        list_lock_release(&(currShard->head.lock));
+        list_lock_destroy(&(currShard->head.lock));
+    }
+
+    node_pool_delete(list->pool);
     free(list);
+}
+
+typedef struct {
+    size_t start; //the unit builds the nodes of values[start .. end).
+    size_t end;
+    int shard;
+    node *first;
+    node *last;
+} build_unit;
 
-    //In case its null, the while wouldn't work, in case list has values, we will loop throw the while.
-    while (nodeList) {
-        pthread_mutex_lock(&(nodeList->mutex));
-        deleteNode = nodeList; //The node we want to delete.
-        nodeList = nodeList->next; //Advance NodeList
-        pthread_mutex_unlock(&deleteNode->mutex);
-        pthread_mutex_destroy(&(deleteNode->mutex));
-        free(deleteNode);
+typedef struct {
+    list *list;
+    const int *values;
+    build_unit *units;
+    int unitCount;
+    int nextUnit; //the next unit a thread takes.
+} build_job;
+
+static void *build_worker(void *arg) {
+    //Every unit is a chain of new nodes, nobody else sees the list yet so there is nothing to lock.
+    build_job *job = (build_job *) arg;
+    int index;
+    while ((index = __atomic_fetch_add(&job->nextUnit, 1, __ATOMIC_RELAXED)) < job->unitCount) {
+        build_unit *unit = &job->units[index];
+        node *prevNode = NULL;
+        size_t i;
+        for (i = unit->start; i < unit->end; i++) {
+            node *newNode = (node *) node_pool_alloc(job->list->pool);
+            set_value(newNode, job->values[i]);
+            if (prevNode) {
+                set_next(prevNode, newNode);
+            } else {
+                unit->first = newNode;
+            }
+            prevNode = newNode;
+        }
+        set_next(prevNode, NULL);
+        unit->last = prevNode;
     }
+    return NULL;
 }
 
-void insert_value(list *list, int value) {
-    if (!list) { //In case list is empty, we can't add anything.
-        return;
+static size_t first_not_below(const int *values, size_t low, size_t high, long long bound) {
+    //Binary search for the first index in [low, high) with values[index] >= bound (high if none).
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (values[mid] < bound) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
     }
-    //First, we create the new value node:
-    node *newNode = (node *) malloc(sizeof(node));
-    if (newNode) {
-        newNode->value = value;
-        newNode->next = NULL;
-        int result = pthread_mutex_init(&(newNode->mutex), NULL);
-        if (result != 0) { //Unsuccessful mutex initialize (if we get 0, it means we succeeded).
-            free(newNode);
-            return;
+    return low;
+}
+
+list *create_list_from_sorted(const int *values, size_t count) {
+    //The nodes are built straight in their final order - no search, no locks, O(n) in total,
+    //and a big array is cut into units that several threads build at once, then we link the units.
+    //With shards, the bounds go to the quantiles of the values right away.
+    size_t i;
+    for (i = 1; i < count; i++) {
+        if (values[i] < values[i - 1]) { //Not sorted after all, the batch insert sorts it for us.
+            list *newList = create_list();
+            insert_values(newList, values, count);
+            return newList;
         }
-    } else { //Error with memory allocation (malloc)
+    }
+    list *newList = create_list();
+    if (!newList || count == 0) {
+        return newList;
+    }
+
+    size_t shardStarts[LIST_SHARDS + 1];
+    shardStarts[0] = 0;
+    shardStarts[LIST_SHARDS] = count;
+    int s;
+    for (s = 1; s < LIST_SHARDS; s++) {
+        //Same cut as rebalance_shards, equal parts and the bound is the first value of the part.
+        size_t cut = count / LIST_SHARDS * s;
+        long long bound = cut < count ? (long long) values[cut] : (long long) INT_MAX + s;
+        if (bound <= newList->lowerBounds[s - 1]) {
+            bound = newList->lowerBounds[s - 1] + 1;
+        }
+        newList->lowerBounds[s] = bound;
+        shardStarts[s] = first_not_below(values, shardStarts[s - 1], count, bound);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = count >= BUILD_PARALLEL_MIN && cpus > 1 ? (int) cpus : 1;
+    size_t unitCapacity = (size_t) threads * BUILD_UNITS_PER_THREAD;
+    size_t unitSize = (count + unitCapacity - 1) / unitCapacity;
+    build_unit *units = (build_unit *) malloc((count / unitSize + LIST_SHARDS) * sizeof(build_unit));
+    if (!units) { //Error with memory allocation (malloc)
         perror("error");
         exit(1);
     }
+    int unitCount = 0;
+    for (s = 0; s < LIST_SHARDS; s++) { //A unit never crosses a shard.
+        for (i = shardStarts[s]; i < shardStarts[s + 1]; i += unitSize) {
+            units[unitCount].start = i;
+            units[unitCount].end = shardStarts[s + 1] - i < unitSize ? shardStarts[s + 1] : i + unitSize;
+            units[unitCount].shard = s;
+            unitCount++;
+        }
+    }
 
-    pthread_mutex_lock(&(list->mutex));
-    node *currNode = list->nodeList;
-    node *prevNode = NULL;
+    build_job job;
+    job.list = newList;
+    job.values = values;
+    job.units = units;
+    job.unitCount = unitCount;
+    job.nextUnit = 0;
+    pthread_t helpers[threads];
+    int created = 0;
+    while (created < threads - 1 && pthread_create(&helpers[created], NULL, build_worker, &job) == 0) {
+        created++;
+    }
+    build_worker(&job);
+    while (created > 0) {
+        pthread_join(helpers[--created], NULL);
+    }
 
-    if (currNode) {
-        pthread_mutex_lock(&(currNode->mutex));
+    //Linking the units of every shard in order.
+    node *prevNodes[LIST_SHARDS];
+    for (s = 0; s < LIST_SHARDS; s++) {
+        prevNodes[s] = &newList->shards[s].head;
+        newList->shards[s].size = (long) (shardStarts[s + 1] - shardStarts[s]);
+    }
+    int u;
+    for (u = 0; u < unitCount; u++) {
+        set_next(prevNodes[units[u].shard], units[u].first);
+        prevNodes[units[u].shard] = units[u].last;
+    }
+    free(units);
+    return newList;
+}
 
-    } else {
-        //NodeList is empty, now we create a new head node for it.
-        list->nodeList = newNode;
-        pthread_mutex_unlock(&(list->mutex));
+void insert_value(list *list, int value) {
+    if (!list) { //In case list is empty, we can't add anything.
         return;
     }
-    pthread_mutex_unlock(&(list->mutex));
+    //First, we create the new value node (from the pool, its lock is already initialized):
+    node *newNode = (node *) node_pool_alloc(list->pool);
+    set_value(newNode, value);
 
+    //Hand over hand from the head sentinel of the value shard, so the head is just another prev node:
+    //we always hold prev, and lock curr before we look at it.
+    shard *currShard = lock_shard_of(list, value);
+    node *prevNode = &currShard->head;
+    node *currNode = prevNode->next;
 
     //We need to traverse till we get to the right value position. (or the end, whatever comes first).
-    // if we got here, 3 cases:
-    // 1. we might need to replace the list head. (our new value is smaller than the head value).
-    // 2. we might need to add it in between
-    // 3. we might need to add it in the end.
-    //Self note: the same value can repeat several times!
-    while (currNode) { //Travel over the nodeList
+    //Self note: the same value can repeat several times! the new node goes after all the equal values.
+    while (currNode) {
+        list_lock_acquire(&(currNode->lock));
         if (value < currNode->value) {
-            if (!prevNode) { //we are in the head pointer, and we need to replace the list head.
-                pthread_mutex_lock(&(list->mutex));
-                newNode->next = currNode;
-                list->nodeList = newNode;
-                pthread_mutex_unlock(&(list->mutex));
-                pthread_mutex_unlock(&(currNode->mutex));
-                return;
-            } else { //We need to insert it between prev and current node.
-                newNode->next = currNode;
-                prevNode->next = newNode;
-                pthread_mutex_unlock(&(prevNode->mutex));
-                pthread_mutex_unlock(&(currNode->mutex));
-                return;
-            }
-        } else {
-            //We check if we got to the end, if so, we need to add it in the end.
-            if (!currNode->next) {
-                currNode->next = newNode;
-                if(prevNode){
-                    pthread_mutex_unlock(&(prevNode->mutex));
-                }
-                pthread_mutex_unlock(&(currNode->mutex));
-                return;
-            }
-            //Advance in the list (if we haven't found the right spot yet).
-            if(prevNode){
-                pthread_mutex_unlock(&(prevNode->mutex));
-            }
-            prevNode = currNode;
-            currNode = currNode->next;
-            if (currNode) {
-                pthread_mutex_lock(&(currNode->mutex));
+            break;
+        }
+        //Advance in the list (if we haven't found the right spot yet).
+        list_lock_release(&(prevNode->lock));
+        prevNode = currNode;
+        currNode = currNode->next;
+        LIST_STATS_STEP();
+    }
+
+    //Inserting between prev and curr (prev is the head in case the value is the smallest, curr is null in the end).
+    write_begin(currShard);
+    set_next(newNode, currNode);
+    set_next(prevNode, newNode);
+    write_end(currShard);
+    long size = add_size(currShard, 1);
+    if (currNode) {
+        list_lock_release(&(currNode->lock));
+    }
+    list_lock_release(&(prevNode->lock));
+    LIST_STATS_OP(LIST_OP_INSERT);
+    check_balance(list, size, 1);
+}
+
+/**
+ * Removes the first node of the value from one shard.
+ * @return 1 if the shard had the value.
+ */
+static int remove_from_shard(list *list, shard *currShard, int value) {
+    node *prevNode = &currShard->head;
+    list_lock_acquire_head(&(prevNode->lock));
+    node *currNode = prevNode->next;
+
+    while (currNode) {
+        list_lock_acquire(&(currNode->lock)); //we lock the next node first.
+        //Using return so if we have several with the same value, it will delete only 1 per function call.
+        if (currNode->value == value) {
+            write_begin(currShard);
+            set_next(prevNode, currNode->next);
+            write_end(currShard);
+            if (is_foreign(list, currShard, value)) {
+                __atomic_fetch_sub(&currShard->foreign, 1, __ATOMIC_RELAXED);
             }
+            add_size(currShard, -1);
+            list_lock_release(&(currNode->lock));
+            list_lock_release(&(prevNode->lock));
+            node_pool_free(list->pool, currNode);
+            return 1;
         }
+        //unlocking the old prev, current nodes becomes the prev in the next run
+        list_lock_release(&(prevNode->lock));
+        prevNode = currNode;
+        currNode = currNode->next;
+        LIST_STATS_STEP();
     }
+    list_lock_release(&(prevNode->lock)); //in the last run it remains locked, unlocking.
+    return 0;
 }
 
 void remove_value(list *list, int value) {
     /*
-     * 1. The remove is in the start - not hard.
-     * 2. The remove is in the middle - the "hardest"
-     * 3. The remove is in the end - not hard.
+     * The head sentinel is always the prev of the first node, so removing from the start, the middle
+     * and the end is the same code.
+     * With shards, the first occurrence is in the first shard (in order) that may hold the value,
+     * and if we found nothing while values moved between shards, we look again (a swap could move
+     * the value to a shard we already passed).
      */
     if (!list) { //The list is empty.
         return;
     }
 
-    pthread_mutex_lock(&(list->mutex));
-    node *prevNode = NULL;
-    node *currNode = list->nodeList;
+    unsigned long moves;
+    do {
+        moves = load_moves(list);
+        int i;
+        for (i = 0; i < LIST_SHARDS; i++) {
+            if (may_hold(list, i, value) && remove_from_shard(list, &list->shards[i], value)) {
+                LIST_STATS_OP(LIST_OP_REMOVE);
+                return;
+            }
+        }
+    } while (moves != load_moves(list));
+    LIST_STATS_OP(LIST_OP_REMOVE);
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int *) a;
+    int y = *(const int *) b;
+    return (x > y) - (x < y);
+}
 
-    if (currNode) { //we have nodelist
-        //locking the first node, it must exist if we got here.
-        pthread_mutex_lock(&(currNode->mutex));
+/**
+ * Returns a sorted copy of the batch, in buffer if it fits (no malloc for small batches).
+ * The caller frees the result if it is not buffer.
+ */
+static int *sorted_batch(const int *values, size_t count, int *buffer, size_t bufferSize) {
+    int *sorted = buffer;
+    if (count > bufferSize) {
+        sorted = (int *) malloc(count * sizeof(int));
+        if (!sorted) { //Error with memory allocation (malloc)
+            perror("error");
+            exit(1);
+        }
+    }
+    size_t i;
+    for (i = 0; i < count; i++) {
+        sorted[i] = values[i];
     }
-    pthread_mutex_unlock(&(list->mutex));
+    qsort(sorted, count, sizeof(int), compare_ints);
+    return sorted;
+}
 
+void insert_values(list *list, const int *values, size_t count) {
+    //We sort the batch, and then merge it into the list in one hand over hand pass,
+    //so every node lock is taken once per batch instead of once per value.
+    //With shards, every run of values of the same shard is merged into that shard.
+    if (!list || count == 0) {
+        return;
+    }
+    int buffer[BATCH_STACK_SIZE];
+    int *sorted = sorted_batch(values, count, buffer, BATCH_STACK_SIZE);
 
-    while (currNode) {
-        //Using return so if we have several with the same value, it will delete only 1 per function call.
-        if (currNode->value == value) {
-            if (!prevNode) { //No previous -> we delete the head!
-                pthread_mutex_lock(&(list->mutex));
-                list->nodeList = currNode->next;
-                pthread_mutex_unlock(&(list->mutex));
-
-                pthread_mutex_unlock(&(currNode->mutex));
-                pthread_mutex_destroy(&(currNode->mutex));
-                free(currNode);
-                return;
+    size_t i = 0;
+    while (i < count) {
+        shard *currShard = lock_shard_of(list, sorted[i]);
+        size_t end = i + 1;
+        while (end < count && !is_foreign(list, currShard, sorted[end])) {
+            end++;
+        }
+
+        node *prevNode = &currShard->head;
+        node *currNode = prevNode->next;
+        if (currNode) {
+            list_lock_acquire(&(currNode->lock));
+        }
+
+        size_t j = i;
+        while (j < end) {
+            if (currNode && currNode->value <= sorted[j]) {
+                //Advance in the list (the new value goes after all the equal values, same as insert_value).
+                list_lock_release(&(prevNode->lock));
+                prevNode = currNode;
+                currNode = currNode->next;
+                LIST_STATS_STEP();
+                if (currNode) {
+                    list_lock_acquire(&(currNode->lock));
+                }
+                continue;
+            }
+            //Inserting between prev and curr, the new node is locked and becomes the prev for the next value.
+            node *newNode = (node *) node_pool_alloc(list->pool);
+            set_value(newNode, sorted[j]);
+            set_next(newNode, currNode);
+            list_lock_acquire(&(newNode->lock));
+            write_begin(currShard);
+            set_next(prevNode, newNode);
+            write_end(currShard);
+            list_lock_release(&(prevNode->lock));
+            prevNode = newNode;
+            j++;
+        }
+
+        long size = add_size(currShard, (long) (end - i));
+        if (currNode) {
+            list_lock_release(&(currNode->lock));
+        }
+        list_lock_release(&(prevNode->lock));
+        check_balance(list, size, (long) (end - i));
+        i = end;
+    }
+    LIST_STATS_OP(LIST_OP_INSERT_BATCH);
+
+    if (sorted != buffer) {
+        free(sorted);
+    }
+}
+
+/**
+ * One hand over hand pass over a shard for remove_values.
+ * @param removed - removed[i] is how many times sorted[i]'s value was removed so far, kept on its first index.
+ * @param left - values we still need to remove.
+ * @return how many values we removed from the shard.
+ */
+static size_t remove_values_from_shard(list *list, shard *currShard, const int *sorted, size_t count,
+                                       size_t *removed, size_t left) {
+    size_t removedNow = 0;
+    node *prevNode = &currShard->head;
+    list_lock_acquire_head(&(prevNode->lock));
+    node *currNode = prevNode->next;
+
+    while (currNode && removedNow < left) {
+        list_lock_acquire(&(currNode->lock));
+
+        //Binary search for the first index of the value, the copies of a value sit right after it.
+        size_t low = 0;
+        size_t high = count;
+        while (low < high) {
+            size_t mid = low + (high - low) / 2;
+            if (sorted[mid] < currNode->value) {
+                low = mid + 1;
             } else {
-                prevNode->next = currNode->next;
-                pthread_mutex_unlock(&(prevNode->mutex));
+                high = mid;
+            }
+        }
+        if (low < count && sorted[low] == currNode->value && low + removed[low] < count &&
+            sorted[low + removed[low]] == currNode->value) {
+            removed[low]++;
+            removedNow++;
+            write_begin(currShard);
+            set_next(prevNode, currNode->next);
+            write_end(currShard);
+            if (is_foreign(list, currShard, currNode->value)) {
+                __atomic_fetch_sub(&currShard->foreign, 1, __ATOMIC_RELAXED);
+            }
+            list_lock_release(&(currNode->lock));
+            node_pool_free(list->pool, currNode);
+            currNode = prevNode->next; //prev stays locked, it is still the prev of the next node.
+            LIST_STATS_STEP();
+            continue;
+        }
 
-                pthread_mutex_unlock(&(currNode->mutex));
-                pthread_mutex_destroy(&(currNode->mutex));
-                free(currNode);
-                return;
+        list_lock_release(&(prevNode->lock));
+        prevNode = currNode;
+        currNode = currNode->next;
+        LIST_STATS_STEP();
+    }
+    add_size(currShard, -(long) removedNow);
+    list_lock_release(&(prevNode->lock));
+    return removedNow;
+}
+
+void remove_values(list *list, const int *values, size_t count) {
+    //One hand over hand pass, every node is checked against the sorted batch with a binary search,
+    //so like remove_value we remove the first occurrences and don't depend on the list order.
+    //With shards, the pass goes over the shards (in order) that may hold a value of the batch.
+    if (!list || count == 0) {
+        return;
+    }
+    int buffer[BATCH_STACK_SIZE];
+    int *sorted = sorted_batch(values, count, buffer, BATCH_STACK_SIZE);
+    size_t removedBuffer[BATCH_STACK_SIZE];
+    size_t *removed = removedBuffer;
+    if (count > BATCH_STACK_SIZE) {
+        removed = (size_t *) malloc(count * sizeof(size_t));
+        if (!removed) { //Error with memory allocation (malloc)
+            perror("error");
+            exit(1);
+        }
+    }
+    size_t i;
+    for (i = 0; i < count; i++) {
+        removed[i] = 0;
+    }
+    size_t left = count; //values we still need to remove.
+
+    unsigned long moves;
+    do {
+        moves = load_moves(list);
+        int index;
+        for (index = 0; index < LIST_SHARDS && left > 0; index++) {
+            shard *currShard = &list->shards[index];
+            int holds = __atomic_load_n(&currShard->foreign, __ATOMIC_RELAXED) > 0;
+            for (i = 0; !holds && i < count; i++) {
+                holds = !is_foreign(list, currShard, sorted[i]);
+            }
+            if (!holds) {
+                continue;
             }
+            size_t removedNow = remove_values_from_shard(list, currShard, sorted, count, removed, left);
+            left -= removedNow;
+        }
+    } while (left > 0 && moves != load_moves(list));
+    LIST_STATS_OP(LIST_OP_REMOVE_BATCH);
+
+    if (removed != removedBuffer) {
+        free(removed);
+    }
+    if (sorted != buffer) {
+        free(sorted);
+    }
+}
+
+static int count_shard(shard *currShard, int (*predicate)(int)) {
+    int count = 0;
+    node *prevNode = &currShard->head;
+    list_lock_acquire_head(&(prevNode->lock));
+    node *currNode = prevNode->next;
+
+    while (currNode) {
+        //in case we have next, we lock it, and only then unlock the prev.
+        list_lock_acquire(&(currNode->lock));
+        list_lock_release(&(prevNode->lock));
+        if (predicate(currNode->value)) {
+            count++;
         }
+        prevNode = currNode;
+        currNode = currNode->next;
+        LIST_STATS_STEP();
+    }
+    list_lock_release(&(prevNode->lock));
+    return count;
+}
 
-        node *next = currNode->next;
-        if (next) {
-            pthread_mutex_lock(&(next->mutex));  //we lock the next node first.
+static char *shard_text(shard *currShard, size_t *length) {
+    //print_list of a big sharded list - every thread prints its shards into a buffer, and they go out in order after.
+    size_t capacity = 4096;
+    size_t used = 0;
+    char *text = (char *) malloc(capacity);
+    if (!text) { //Error with memory allocation (malloc)
+        perror("error");
+        exit(1);
+    }
+
+    node *prevNode = &currShard->head;
+    list_lock_acquire_head(&(prevNode->lock));
+    node *currNode = prevNode->next;
+    while (currNode) {
+        list_lock_acquire(&(currNode->lock));
+        list_lock_release(&(prevNode->lock));
+        if (capacity - used < 16) { //"-2147483648 " takes 12 chars.
+            capacity *= 2;
+            text = (char *) realloc(text, capacity);
+            if (!text) {
+                perror("error");
+                exit(1);
+            }
         }
-        if (prevNode) {
-            //unlocking the old prev.
-            pthread_mutex_unlock(&prevNode->mutex);
+        used += (size_t) snprintf(text + used, capacity - used, "%d ", currNode->value);
+        prevNode = currNode;
+        currNode = currNode->next;
+        LIST_STATS_STEP();
+    }
+    list_lock_release(&(prevNode->lock));
+    *length = used;
+    return text;
+}
+
+typedef struct {
+    list *list;
+    int (*predicate)(int); //count_list, NULL for print_list.
+    int nextShard; //the next shard a thread takes.
+    int counts[LIST_SHARDS];
+    char *texts[LIST_SHARDS];
+    size_t lengths[LIST_SHARDS];
+} shard_job;
+
+static void *shard_worker(void *arg) {
+    shard_job *job = (shard_job *) arg;
+    int index;
+    while ((index = __atomic_fetch_add(&job->nextShard, 1, __ATOMIC_RELAXED)) < LIST_SHARDS) {
+        if (job->predicate) {
+            job->counts[index] = count_shard(&job->list->shards[index], job->predicate);
+        } else {
+            job->texts[index] = shard_text(&job->list->shards[index], &job->lengths[index]);
         }
-        prevNode = currNode; //current nodes becomes the prev in the next run
-        currNode = next;
     }
-    if (prevNode) { //in the last run it might remain locked, unlocking.
-        pthread_mutex_unlock(&prevNode->mutex);
+    return NULL;
+}
+
+static int parallel_threads(list *list) {
+    //Threads are worth it only for a big list, and there is no point in more threads than shards or CPUs.
+    if (LIST_SHARDS == 1) {
+        return 1;
+    }
+    long total = 0;
+    int i;
+    for (i = 0; i < LIST_SHARDS; i++) {
+        total += __atomic_load_n(&list->shards[i].size, __ATOMIC_RELAXED);
+    }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (total < SHARD_PARALLEL_MIN || cpus < 2) {
+        return 1;
     }
+    return cpus < LIST_SHARDS ? (int) cpus : LIST_SHARDS;
+}
 
+static void run_shard_job(shard_job *job, int threads) {
+    //We work too, and the shards nobody took yet are left for whoever is free (so a failed pthread_create is fine).
+    pthread_t helpers[LIST_SHARDS];
+    int created = 0;
+    job->nextShard = 0;
+    while (created < threads - 1 && pthread_create(&helpers[created], NULL, shard_worker, job) == 0) {
+        created++;
+    }
+    shard_worker(job);
+    while (created > 0) {
+        pthread_join(helpers[--created], NULL);
+    }
 }
 
 void print_list(list *list) {
@@ -217,25 +924,40 @@ void print_list(list *list) {
         return;
     }
 
-    pthread_mutex_lock(&(list->mutex));
-    node *currNode = list->nodeList;
-    if (currNode) {
-        pthread_mutex_lock(&(currNode->mutex));
+    int threads = parallel_threads(list);
+    int i;
+    if (threads > 1) {
+        shard_job job;
+        job.list = list;
+        job.predicate = NULL;
+        run_shard_job(&job, threads);
+        for (i = 0; i < LIST_SHARDS; i++) {
+            fwrite(job.texts[i], 1, job.lengths[i], stdout);
+            free(job.texts[i]);
+        }
+        printf("\n"); // DO NOT DELETE
+        LIST_STATS_OP(LIST_OP_PRINT);
+        return;
     }
-    node *prevNode = NULL;
-    pthread_mutex_unlock(&(list->mutex));
 
-    while (currNode) {
-        print_node(currNode);
-        prevNode = currNode;
-        currNode = currNode->next;
-        if (currNode) { //making sure it's not null, it can be in the end.
-            pthread_mutex_lock(&(currNode->mutex));
+    for (i = 0; i < LIST_SHARDS; i++) {
+        node *prevNode = &list->shards[i].head;
+        list_lock_acquire_head(&(prevNode->lock));
+        node *currNode = prevNode->next;
+
+        while (currNode) {
+            list_lock_acquire(&(currNode->lock));
+            list_lock_release(&(prevNode->lock));
+            print_node(currNode);
+            prevNode = currNode;
+            currNode = currNode->next;
+            LIST_STATS_STEP();
         }
-        pthread_mutex_unlock(&(prevNode->mutex));
+        list_lock_release(&(prevNode->lock));
     }
 
     printf("\n"); // DO NOT DELETE
+    LIST_STATS_OP(LIST_OP_PRINT);
 }
 
 void count_list(list *list, int (*predicate)(int)) {
@@ -246,30 +968,203 @@ void count_list(list *list, int (*predicate)(int)) {
         return;
     }
 
-    pthread_mutex_lock(&(list->mutex));
-    node *currNode = list->nodeList;
-    if (currNode) {
-        pthread_mutex_lock(&(currNode->mutex));
+    //Every shard is counted on its own (in parallel for a big sharded list, so the predicate must be thread safe).
+    shard_job job;
+    job.list = list;
+    job.predicate = predicate;
+    run_shard_job(&job, parallel_threads(list));
+    int i;
+    for (i = 0; i < LIST_SHARDS; i++) {
+        count += job.counts[i];
     }
-    node *prevNode;
-    pthread_mutex_unlock(&(list->mutex));
 
-    while (currNode) {
-        if (predicate(currNode->value)) {
-            count++;
+    printf("%d items were counted\n", count); // DO NOT DELETE
+    LIST_STATS_OP(LIST_OP_COUNT);
+}
+
+static void update_foreign(list *list, shard *shard, int oldValue, int newValue) {
+    //A node of the shard changed its value (we hold its lock, so the bounds can't move).
+    long change = is_foreign(list, shard, newValue) - is_foreign(list, shard, oldValue);
+    if (change) {
+        __atomic_fetch_add(&shard->foreign, change, __ATOMIC_RELAXED);
+    }
+}
+
+static void swap_locked(list *list, node *firstNodePtr, shard *firstShard, node *secondNodePtr, shard *secondShard) {
+    //Switching the values of two nodes we hold the locks of, and releasing them.
+    //Across shards the nodes stay where they are, and the shards remember they hold a foreign value.
+    int val1 = firstNodePtr->value;
+    int val2 = secondNodePtr->value;
+    write_begin(firstShard);
+    if (secondShard != firstShard) {
+        write_begin(secondShard);
+    }
+    set_value(firstNodePtr, val2);
+    set_value(secondNodePtr, val1);
+    if (secondShard != firstShard) {
+        write_end(secondShard);
+    }
+    write_end(firstShard);
+    if (secondShard != firstShard) {
+        update_foreign(list, firstShard, val1, val2);
+        update_foreign(list, secondShard, val2, val1);
+        __atomic_fetch_add(&list->moves, 1, __ATOMIC_RELEASE); //before the unlock, see remove_value.
+    }
+    list_lock_release(&(firstNodePtr->lock));
+    list_lock_release(&(secondNodePtr->lock));
+}
+
+/**
+ * Finds the first node of each value without locks (seqlock read, stops as soon as it has both),
+ * then locks just the two nodes and checks that nobody wrote to the list in the meantime.
+ * @return 1 if the swap is done (or one of the values is not in the list), 0 if we need to try again.
+ */
+static int optimistic_swap(list *list, int val1, int val2) {
+    //A swap across shards changes the foreign counts only after its write, so like the locked way
+    //we also check that no value moved shards while we looked (may_hold could have skipped a shard).
+    unsigned long moves = load_moves(list);
+    unsigned long version;
+    if (!read_begin(list, &version)) {
+        return 0;
+    }
+
+    node *firstNodePtr = NULL;
+    node *secondNodePtr = NULL;
+    shard *firstShard = NULL;
+    shard *secondShard = NULL;
+    node *metFirst = NULL; //the one of the two we met first in the list.
+    unsigned long steps = 0;
+    int index;
+    for (index = 0; index < LIST_SHARDS && (!firstNodePtr || !secondNodePtr); index++) {
+        if (!may_hold(list, index, val1) && !may_hold(list, index, val2)) {
+            continue;
         }
-        prevNode = currNode;
-        currNode = currNode->next;
-        if (currNode) {
-            //in case we have next,we lock it
-            pthread_mutex_lock(&(currNode->mutex));
+        node *currNode = load_next(&list->shards[index].head);
+        while (currNode && (!firstNodePtr || !secondNodePtr)) {
+            int value = load_value(currNode);
+            if (value == val1 && !firstNodePtr) {
+                firstNodePtr = currNode;
+                firstShard = &list->shards[index];
+            } else if (value == val2 && !secondNodePtr) {
+                secondNodePtr = currNode;
+                secondShard = &list->shards[index];
+            }
+            if (!metFirst) {
+                metFirst = firstNodePtr ? firstNodePtr : secondNodePtr;
+            }
+            currNode = load_next(currNode);
+            LIST_STATS_STEP();
+            if (++steps % READ_CHECK_STEPS == 0 && !read_validate(list, version)) {
+                return 0;
+            }
         }
-        pthread_mutex_unlock(&(prevNode->mutex));
     }
-    printf("%d items were counted\n", count); // DO NOT DELETE
+    if (!read_validate(list, version) || moves != load_moves(list)) {
+        return 0;
+    }
+    if (!firstNodePtr || !secondNodePtr) { //We can't switch if one of the values is missing.
+        return 1;
+    }
+
+    //Everybody locks in list order, so we block only on the node we met first. A node can be freed and
+    //reused somewhere else before we lock it, so the second one is only a try, and if we can't get it
+    //we let go of the first one (no deadlock either way).
+    node *metSecond = metFirst == firstNodePtr ? secondNodePtr : firstNodePtr;
+    list_lock_acquire(&(metFirst->lock));
+    if (!list_lock_try_acquire(&(metSecond->lock))) {
+        list_lock_release(&(metFirst->lock));
+        return 0;
+    }
+    //Both nodes are still linked and still the first of their values, and no lock_all_shards got past them.
+    if (!read_validate(list, version) || moves != load_moves(list)) {
+        list_lock_release(&(metSecond->lock));
+        list_lock_release(&(metFirst->lock));
+        return 0;
+    }
+    swap_locked(list, firstNodePtr, firstShard, secondNodePtr, secondShard);
+    return 1;
+}
+
+static void locked_swap(list *list, int val1, int val2) {
+    //Hand over hand like the other writers, for when the writers keep changing the list under the lock-free search.
+    //Pointers for the values nodes
+    node *firstNodePtr = NULL;
+    node *secondNodePtr = NULL;
+    shard *firstShard = NULL;
+    shard *secondShard = NULL;
+    unsigned long moves;
+    do {
+        moves = load_moves(list);
+        //Shard by shard in order, the nodes we found stay locked while we go on to the next shards
+        //(the same order as everybody else - shards in order, and list order inside a shard).
+        int index;
+        for (index = 0; index < LIST_SHARDS && (!firstNodePtr || !secondNodePtr); index++) {
+            if (!may_hold(list, index, val1) && !may_hold(list, index, val2)) {
+                continue;
+            }
+            shard *currShard = &list->shards[index];
+
+            //Pointer to the ptr we will use to run over the list node with.
+            list_lock_acquire_head(&(currShard->head.lock));
+            node *currNode = currShard->head.next;
+            if (currNode) {
+                list_lock_acquire(&(currNode->lock));
+            }
+            list_lock_release(&(currShard->head.lock));
+
+            node *prevNodePtr = NULL; //I want to advance to next node before I unlock the node lock (better behavior), so using this as a helper pointer.
+
+            //Finding the values locations, we stop as soon as we have both (currNode is one of them then).
+            while (currNode != NULL) {
+                if (currNode->value == val1 && !firstNodePtr) {
+                    //the value is equal to the first value, and first value is null (not set up already).
+                    firstNodePtr = currNode;
+                    firstShard = currShard;
+                } else if (currNode->value == val2 && !secondNodePtr) {
+                    //second val, else, so we don't lock both (in case they are equal, even with the if statement beforehand).
+                    secondNodePtr = currNode;
+                    secondShard = currShard;
+                }
+                if (firstNodePtr && secondNodePtr) {
+                    break;
+                }
+                prevNodePtr = currNode;
+                currNode = currNode->next;
+                LIST_STATS_STEP();
+                if (currNode) { //locking the next node
+                    list_lock_acquire(&(currNode->lock));
+                }
+                if (prevNodePtr != firstNodePtr && prevNodePtr != secondNodePtr) {
+                    //unlocking the current node (not the next), in case it's not equal to first Node or the second Node
+                    list_lock_release(&(prevNodePtr->lock));
+                }
+            }
+        }
+        if (firstNodePtr && secondNodePtr) {
+            break;
+        }
+
+        //Unlock the pointers in case we found only 1 pointer and can not complete the switch.
+        if (firstNodePtr) {
+            list_lock_release(&(firstNodePtr->lock));
+        }
+        if (secondNodePtr) {
+            list_lock_release(&(secondNodePtr->lock));
+        }
+        firstNodePtr = NULL;
+        secondNodePtr = NULL;
+    } while (moves != load_moves(list)); //A value could have moved to a shard we already passed.
+
+    //We found both nodes, if not, we can't really switch.
+    if (firstNodePtr && secondNodePtr) {
+        swap_locked(list, firstNodePtr, firstShard, secondNodePtr, secondShard);
+    }
 }
 
 void swap_values(list *list, int val1, int val2) {
+    //First we look for the two nodes without locks and lock only them (so nobody waits behind a node we
+    //already found while we look for the other one), and if the list keeps changing under us we go hand over hand.
+    //Both ways stop as soon as they found the two values.
 
     //we know that val1 and val2 are different (even if we change them, it doesn't harm anything, just wasteful).
     if (!list || val1 == val2) {
@@ -277,60 +1172,338 @@ void swap_values(list *list, int val1, int val2) {
         return;
     }
 
-    //Pointer to the ptr we will use to run over the list node with.
-    pthread_mutex_lock(&(list->mutex));
-    node *currNode = list->nodeList;
-    if (currNode) {
-        pthread_mutex_lock(&(currNode->mutex));
+    int i;
+    for (i = 0; i < READ_TRIES; i++) {
+        if (optimistic_swap(list, val1, val2)) {
+            LIST_STATS_OP(LIST_OP_SWAP);
+            return;
+        }
     }
-    pthread_mutex_unlock(&(list->mutex));
+    locked_swap(list, val1, val2);
+    LIST_STATS_OP(LIST_OP_SWAP);
+}
 
-    //Pointers for the values nodes
-    node *firstNodePtr = NULL;
-    node *secondNodePtr = NULL;
-    node *prevNodePtr = NULL; //I want to advance to next node before I unlock the node mutex (better behavior), so using this as a helper pointer.
-
-    //Finding the values locations
-    while (currNode != NULL) {
-        if (currNode->value == val1 && !firstNodePtr) {
-            //the value is equal to the first value, and first value is null (not set up already).
-            firstNodePtr = currNode;
-        } else if (currNode->value == val2 && !secondNodePtr) {
-            //second val, else, so we don't lock both (in case they are equal, even with the if statement beforehand).
-            secondNodePtr = currNode;
-        }
-        prevNodePtr = currNode;
-        currNode = currNode->next;
-        if (currNode) { //locking the next node
-            pthread_mutex_lock(&(currNode->mutex));
+typedef struct {
+    long position; //index of the node in the list (shards in order).
+    node *node;
+    shard *shard;
+} swap_slot;
+
+static int find_key(const int *keys, int count, int value) {
+    int low = 0;
+    int high = count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (keys[mid] < value) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
-        if (prevNodePtr != firstNodePtr && prevNodePtr != secondNodePtr) {
-            //unlocking the current node (not the next), in case it's not equal to first Node or the second Node
-            pthread_mutex_unlock(&(prevNodePtr->mutex));
+    }
+    return low < count && keys[low] == value ? low : -1;
+}
+
+static swap_slot heap_pop(swap_slot *heap, long size) {
+    //Min heap by position, the first node that holds the value.
+    swap_slot top = heap[0];
+    swap_slot last = heap[size - 1];
+    long hole = 0;
+    size--;
+    while (2 * hole + 1 < size) {
+        long child = 2 * hole + 1;
+        if (child + 1 < size && heap[child + 1].position < heap[child].position) {
+            child++;
+        }
+        if (last.position <= heap[child].position) {
+            break;
         }
+        heap[hole] = heap[child];
+        hole = child;
     }
+    heap[hole] = last;
+    return top;
+}
 
-    //We found both nodes, if not, we can't really switch.
-    if (firstNodePtr && secondNodePtr) {
-        //Switching values - we are locked from earlier.
-        int tempVal = firstNodePtr->value;
-        firstNodePtr->value = secondNodePtr->value;
-        secondNodePtr->value = tempVal;
-        //Releasing by order
-        if (firstNodePtr < secondNodePtr) {
-            pthread_mutex_unlock(&(firstNodePtr->mutex));
-            pthread_mutex_unlock(&(secondNodePtr->mutex));
-        } else {
-            pthread_mutex_unlock(&(secondNodePtr->mutex));
-            pthread_mutex_unlock(&(firstNodePtr->mutex));
+static void heap_push(swap_slot *heap, long size, swap_slot slot) {
+    long hole = size;
+    while (hole > 0 && heap[(hole - 1) / 2].position > slot.position) {
+        heap[hole] = heap[(hole - 1) / 2];
+        hole = (hole - 1) / 2;
+    }
+    heap[hole] = slot;
+}
+
+void swap_many(list *list, const int *pairs, size_t count) {
+    //Small batches are just a loop. A big batch takes the whole list for itself (like rebalance_shards)
+    //and does all the swaps with two passes over the list instead of one search per swap:
+    //every value of the batch gets a min heap of the nodes that hold it (by position), a swap pops
+    //the first node of each value and pushes it to the heap of the other value (so a value keeps the
+    //same number of nodes), and that gives the same result as swap_values for every pair in order.
+    if (!list || count == 0) {
+        return;
+    }
+    size_t i;
+    if (count < SWAP_MANY_MIN) {
+        for (i = 0; i < count; i++) {
+            swap_values(list, pairs[2 * i], pairs[2 * i + 1]);
         }
-    } else {
-        //Unlock the pointers in case we found only 1 pointer and can not complete the switch.
-        if (firstNodePtr) {
-            pthread_mutex_unlock(&(firstNodePtr->mutex));
+        return;
+    }
+
+    int *keys = (int *) malloc(2 * count * sizeof(int));
+    if (!keys) { //Error with memory allocation (malloc)
+        perror("error");
+        exit(1);
+    }
+    for (i = 0; i < 2 * count; i++) {
+        keys[i] = pairs[i];
+    }
+    qsort(keys, 2 * count, sizeof(int), compare_ints);
+    int keyCount = 0;
+    for (i = 0; i < 2 * count; i++) {
+        if (keyCount == 0 || keys[keyCount - 1] != keys[i]) {
+            keys[keyCount++] = keys[i];
         }
-        if (secondNodePtr) {
-            pthread_mutex_unlock(&(secondNodePtr->mutex));
+    }
+    long *starts = (long *) calloc((size_t) keyCount + 1, sizeof(long)); //heap of key k is slots[starts[k]..starts[k+1]).
+    if (!starts) {
+        perror("error");
+        exit(1);
+    }
+
+    lock_all_shards(list);
+    //First pass - how many nodes hold every key.
+    int index;
+    for (index = 0; index < LIST_SHARDS; index++) {
+        node *currNode;
+        for (currNode = list->shards[index].head.next; currNode; currNode = currNode->next) {
+            int key = find_key(keys, keyCount, currNode->value);
+            if (key >= 0) {
+                starts[key + 1]++;
+            }
+            LIST_STATS_STEP();
+        }
+    }
+    int k;
+    for (k = 0; k < keyCount; k++) {
+        starts[k + 1] += starts[k];
+    }
+    swap_slot *slots = (swap_slot *) malloc(((size_t) starts[keyCount] + 1) * sizeof(swap_slot));
+    long *filled = (long *) calloc((size_t) keyCount, sizeof(long));
+    if (!slots || !filled) {
+        perror("error");
+        exit(1);
+    }
+    //Second pass - the nodes go in position order, so every heap is already a valid heap.
+    long position = 0;
+    for (index = 0; index < LIST_SHARDS; index++) {
+        node *currNode;
+        for (currNode = list->shards[index].head.next; currNode; currNode = currNode->next) {
+            int key = find_key(keys, keyCount, currNode->value);
+            if (key >= 0) {
+                swap_slot *slot = &slots[starts[key] + filled[key]++];
+                slot->position = position;
+                slot->node = currNode;
+                slot->shard = &list->shards[index];
+            }
+            position++;
+            LIST_STATS_STEP();
         }
     }
+
+    int moved = 0;
+    for (i = 0; i < count; i++) {
+        int val1 = pairs[2 * i];
+        int val2 = pairs[2 * i + 1];
+        if (val1 == val2) {
+            continue;
+        }
+        int key1 = find_key(keys, keyCount, val1);
+        int key2 = find_key(keys, keyCount, val2);
+        long size1 = starts[key1 + 1] - starts[key1];
+        long size2 = starts[key2 + 1] - starts[key2];
+        if (size1 == 0 || size2 == 0) { //We can't switch if one of the values is missing.
+            continue;
+        }
+        swap_slot first = heap_pop(&slots[starts[key1]], size1);
+        swap_slot second = heap_pop(&slots[starts[key2]], size2);
+        set_value(first.node, val2);
+        set_value(second.node, val1);
+        if (first.shard != second.shard) {
+            update_foreign(list, first.shard, val1, val2);
+            update_foreign(list, second.shard, val2, val1);
+            moved = 1;
+        }
+        heap_push(&slots[starts[key2]], size2 - 1, first);
+        heap_push(&slots[starts[key1]], size1 - 1, second);
+    }
+    if (moved) {
+        __atomic_fetch_add(&list->moves, 1, __ATOMIC_RELEASE); //before the unlock, see remove_value.
+    }
+    unlock_all_shards(list);
+    LIST_STATS_OP(LIST_OP_SWAP);
+
+    free(filled);
+    free(slots);
+    free(starts);
+    free(keys);
+}
+
+/**
+ * Counts the values v with lo <= v <= hi without any lock (seqlock read).
+ * @param limit - stop after this many values (1 is enough for contains_value).
+ * @return 1 with the count in countOut, or 0 if a writer changed the list under us.
+ */
+static int optimistic_range_count(list *list, int lo, int hi, int limit, int *countOut) {
+    unsigned long version;
+    if (!read_begin(list, &version)) {
+        return 0;
+    }
+
+    int count = 0;
+    unsigned long steps = 0;
+    int index = shard_of(list, lo);
+    int last = shard_of(list, hi);
+    for (; index <= last && count < limit; index++) {
+        node *currNode = load_next(&list->shards[index].head);
+        while (currNode && count < limit) {
+            int value = load_value(currNode);
+            if (value > hi) { //The list is sorted, nothing after this node.
+                break;
+            }
+            if (value >= lo) {
+                count++;
+            }
+            currNode = load_next(currNode);
+            //A node we hold may be freed and reused, and then its next can even make a cycle,
+            //but that only happens after a new write began, so checking the version now and then is enough.
+            if (++steps % READ_CHECK_STEPS == 0 && !read_validate(list, version)) {
+                return 0;
+            }
+        }
+    }
+    if (!read_validate(list, version)) {
+        return 0;
+    }
+    *countOut = count;
+    return 1;
+}
+
+static int locked_range_count(list *list, int lo, int hi, int limit) {
+    //Hand over hand like count_list, for when the writers keep changing the list under the lock-free reads.
+    int count;
+    unsigned long moves;
+    do {
+        moves = load_moves(list);
+        count = 0;
+        int index = shard_of(list, lo);
+        int last = shard_of(list, hi);
+        for (; index <= last && count < limit; index++) {
+            node *prevNode = &list->shards[index].head;
+            list_lock_acquire_head(&(prevNode->lock));
+            node *currNode = prevNode->next;
+
+            while (currNode && count < limit) {
+                list_lock_acquire(&(currNode->lock));
+                list_lock_release(&(prevNode->lock));
+                prevNode = currNode;
+                if (currNode->value > hi) {
+                    break;
+                }
+                if (currNode->value >= lo) {
+                    count++;
+                }
+                currNode = currNode->next;
+                LIST_STATS_STEP();
+            }
+            list_lock_release(&(prevNode->lock));
+        }
+    } while (moves != load_moves(list));
+    LIST_STATS_OP(LIST_OP_QUERY);
+    return count;
+}
+
+static int query_range(list *list, int lo, int hi, int limit) {
+    int count;
+    int i;
+    for (i = 0; i < READ_TRIES; i++) {
+        if (optimistic_range_count(list, lo, hi, limit, &count)) {
+            return count;
+        }
+    }
+    return locked_range_count(list, lo, hi, limit);
+}
+
+int contains_value(list *list, int value) {
+    if (!list) {
+        return 0;
+    }
+    return query_range(list, value, value, 1);
+}
+
+int range_count(list *list, int lo, int hi) {
+    if (!list || lo > hi) {
+        return 0;
+    }
+    return query_range(list, lo, hi, INT_MAX);
+}
+
+//Iterations on this thread that list_iter_end failed in a row. The caller just begins again, so the count
+//can't live in the list_iter.
+static __thread int iterFailures = 0;
+
+void list_iter_begin(list *list, list_iter *iter) {
+    iter->list = list;
+    iter->nextNode = NULL;
+    iter->shard = 0;
+    iter->index = 0;
+    iter->valid = 0;
+    iter->locked = 0;
+    if (list && iterFailures >= ITER_TRIES) {
+        //The writers kept changing the list under our last tries, this time nobody writes until list_iter_end.
+        lock_all_shards(list);
+        iter->locked = 1;
+        iter->valid = 1;
+        iter->nextNode = list->shards[0].head.next;
+    } else if (list) {
+        iter->valid = read_begin(list, &iter->version);
+        if (iter->valid) {
+            iter->nextNode = load_next(&list->shards[0].head);
+        }
+    }
+}
+
+int list_iter_next(list_iter *iter, int *value) {
+    if (!iter->valid) {
+        return 0;
+    }
+    while (!iter->nextNode && iter->shard < LIST_SHARDS - 1) {
+        iter->shard++;
+        iter->nextNode = load_next(&iter->list->shards[iter->shard].head);
+    }
+    if (!iter->nextNode) {
+        return 0;
+    }
+    if (++iter->index % READ_CHECK_STEPS == 0 && !iter->locked && !read_validate(iter->list, iter->version)) {
+        //Not a snapshot anymore, there is no point to go on (and the node may be reused).
+        iter->valid = 0;
+        return 0;
+    }
+    *value = load_value(iter->nextNode);
+    iter->nextNode = load_next(iter->nextNode);
+    return 1;
+}
+
+int list_iter_end(list_iter *iter) {
+    if (!iter->list) {
+        return 1; //No list, an empty iteration is a snapshot.
+    }
+    if (iter->locked) {
+        unlock_all_shards(iter->list);
+        iterFailures = 0;
+        return 1;
+    }
+    int snapshot = iter->valid && read_validate(iter->list, iter->version);
+    iterFailures = snapshot ? 0 : iterFailures + 1;
+    return snapshot;
 }
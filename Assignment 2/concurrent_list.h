@@ -1,10 +1,52 @@
+#include <stddef.h>
+
 typedef struct node node;
 typedef struct list list;
 
 list* create_list();
+//Builds the list of count sorted values in one pass (no search), O(n) instead of n inserts.
+//If the values turn out not to be sorted, it still works (as create_list + insert_values).
+list* create_list_from_sorted(const int* values, size_t count);
 void delete_list(list* list);
 void print_list(list* list);
 void insert_value(list* list, int value);
 void remove_value(list* list, int value);
-void count_list(list* list, int (*predicate)(int));
+void count_list(list* list, int (*predicate)(int)); //with SHARDS > 1 the predicate can run on several threads at once.
 void swap_values(list* list, int val1, int val2);
+void swap_many(list* list, const int* pairs, size_t count); //swaps pairs[2*i] with pairs[2*i+1], same result as swap_values for every pair in order.
+
+//Batch versions, same result as calling insert_value/remove_value for every value of the array.
+void insert_values(list* list, const int* values, size_t count);
+void remove_values(list* list, const int* values, size_t count);
+
+//Read only queries, they don't print anything and don't block writers.
+//Like insert_value, they assume the list is sorted and stop as soon as they pass the values they look for.
+int contains_value(list* list, int value);
+int range_count(list* list, int lo, int hi); //how many values v with lo <= v <= hi.
+
+//Cursor over the list values in order, it lives on the caller stack (no allocation):
+//    list_iter iter;
+//    int value;
+//    do {
+//        list_iter_begin(list, &iter);
+//        while (list_iter_next(&iter, &value)) { ... }
+//    } while (!list_iter_end(&iter));
+//list_iter_end must always be called, it returns 0 if a writer changed the list during the iteration.
+//concurrent_list and concurrent_list_unrolled give an exact snapshot (retry when list_iter_end returns 0).
+//After a few tries in a row that returned 0 on the same thread, the next iteration holds the list locks until
+//list_iter_end (and always returns 1), so writers can't starve it - the loop body must not change the list then.
+//The epoch based backends (lockfree, lazy, skiplist) give a weakly consistent iteration: every value
+//was in the list at some point of the iteration, and list_iter_end always returns 1.
+typedef struct list_iter {
+    list* list;
+    node* nextNode; //next node to read.
+    int shard; //shard of nextNode (sharded concurrent_list).
+    int index; //next value inside the node (chunked backends), or how many nodes we read so far.
+    unsigned long version; //list version when the iteration began.
+    int valid; //0 once we know the iteration is not a snapshot.
+    int locked; //1 if the iteration holds the list locks (the snapshot backends, after failed tries).
+} list_iter;
+
+void list_iter_begin(list* list, list_iter* iter);
+int list_iter_next(list_iter* iter, int* value);
+int list_iter_end(list_iter* iter);
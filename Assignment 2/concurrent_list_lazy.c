@@ -0,0 +1,395 @@
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "concurrent_list.h"
+#include "epoch.h"
+#include "list_lock.h"
+
+//Lazy (optimistic) sorted list.
+//Traversals take no locks at all. Writers search without locks, lock only the nodes they change
+//and then validate that nothing changed under them, if it did they search again.
+//A removed node is first marked (logical delete) and only then unlinked, so readers just skip marked nodes,
+//and unlinked nodes are retired to the epoch reclamation (epoch.c), readers never see freed memory.
+//swap_values switches the values of two nodes in place (like concurrent_list), so after a swap the list is not
+//sorted any more, and remove_value looks at every node until it finds the value.
+
+struct node {
+    int value; //Current node value.
+    int marked; //1 once the node was logically deleted.
+    node *next; //pointer to the next node.
+    list_lock lock; //the lock for the node (the lock policy is selected at build time, see list_lock.h).
+    epoch_entry retire; //link for the epoch reclamation once the node was unlinked.
+};
+
+struct list {
+    node head; //Sentinel node before the first value, its value is never used.
+};
+
+static inline node *load_next(node *node) {
+    return __atomic_load_n(&node->next, __ATOMIC_ACQUIRE);
+}
+
+static inline int load_value(node *node) {
+    return __atomic_load_n(&node->value, __ATOMIC_RELAXED);
+}
+
+static inline int is_marked(node *node) {
+    return __atomic_load_n(&node->marked, __ATOMIC_ACQUIRE);
+}
+
+static inline void lock_node(list *list, node *node) {
+    //The head sentinel is counted as the list head in the lock statistics (see list_stats.h).
+    if (node == &list->head) {
+        list_lock_acquire_head(&(node->lock));
+    } else {
+        list_lock_acquire(&(node->lock));
+    }
+}
+
+static void destroy_node(epoch_entry *entry) {
+    node *deleteNode = (node *) ((char *) entry - offsetof(node, retire));
+    list_lock_destroy(&(deleteNode->lock));
+    free(deleteNode);
+}
+
+void print_node(node *node) {
+    // DO NOT DELETE
+    if (node) {
+        printf("%d ", node->value);
+    }
+}
+
+list *create_list() {
+    list *newList = (list *) malloc(sizeof(list));
+    if (newList) {
+        newList->head.value = 0;
+        newList->head.marked = 0;
+        newList->head.next = NULL;
+    } else {
+        //Error with memory allocation (malloc).
+        perror("error");
+        exit(1);
+    }
+    int result = list_lock_init(&(newList->head.lock));
+    if (result != 0) { //Unsuccessful lock initialize (if we get 0, it means we succeeded).
+        free(newList);
+        return NULL;
+    }
+    return newList;
+}
+
+void delete_list(list *list) {
+    //No other thread may use the list anymore, unlinked nodes already belong to the epoch reclamation.
+    if (!list) { //List is already NULL, nothing to delete.
+        return;
+    }
+
+    node *currNode = list->head.next;
+    list_lock_destroy(&(list->head.lock));
+    free(list);
+
+    while (currNode) {
+        node *deleteNode = currNode;
+        currNode = currNode->next;
+        list_lock_destroy(&(deleteNode->lock));
+        free(deleteNode);
+    }
+}
+
+list *create_list_from_sorted(const int *values, size_t count) {
+    //Nobody sees the list before we return it, so we just append every node at the end (O(n), no locks).
+    size_t i;
+    for (i = 1; i < count; i++) {
+        if (values[i] < values[i - 1]) { //Not sorted after all, one insert per value.
+            list *newList = create_list();
+            insert_values(newList, values, count);
+            return newList;
+        }
+    }
+    list *newList = create_list();
+    if (!newList) {
+        return NULL;
+    }
+    node *prevNode = &newList->head;
+    for (i = 0; i < count; i++) {
+        node *newNode = (node *) malloc(sizeof(node));
+        if (!newNode) { //Error with memory allocation (malloc)
+            perror("error");
+            exit(1);
+        }
+        if (list_lock_init(&(newNode->lock)) != 0) { //Same as insert_value, the value is skipped.
+            free(newNode);
+            continue;
+        }
+        newNode->value = values[i];
+        newNode->marked = 0;
+        newNode->next = NULL;
+        prevNode->next = newNode;
+        prevNode = newNode;
+    }
+    return newList;
+}
+
+void insert_value(list *list, int value) {
+    if (!list) {
+        return;
+    }
+    node *newNode = (node *) malloc(sizeof(node));
+    if (newNode) {
+        newNode->value = value;
+        newNode->marked = 0;
+        int result = list_lock_init(&(newNode->lock));
+        if (result != 0) { //Unsuccessful lock initialize (if we get 0, it means we succeeded).
+            free(newNode);
+            return;
+        }
+    } else { //Error with memory allocation (malloc)
+        perror("error");
+        exit(1);
+    }
+
+    epoch_enter();
+    while (1) {
+        //Same value can repeat several times, the new node goes after all the equal values.
+        node *prevNode = &list->head;
+        node *currNode = load_next(prevNode);
+        while (currNode && load_value(currNode) <= value) {
+            prevNode = currNode;
+            currNode = load_next(currNode);
+        }
+
+        //Only prev changes, and nobody can remove currNode without locking prev first.
+        lock_node(list, prevNode);
+        if (!is_marked(prevNode) && prevNode->next == currNode) {
+            newNode->next = currNode;
+            __atomic_store_n(&prevNode->next, newNode, __ATOMIC_RELEASE);
+            list_lock_release(&(prevNode->lock));
+            break;
+        }
+        list_lock_release(&(prevNode->lock)); //Validation failed, searching again.
+    }
+    epoch_exit();
+}
+
+void remove_value(list *list, int value) {
+    if (!list) {
+        return;
+    }
+
+    epoch_enter();
+    while (1) {
+        //Not only until the first node >= value, swap_values may have moved the value further on.
+        node *prevNode = &list->head;
+        node *currNode = load_next(prevNode);
+        while (currNode && load_value(currNode) != value) {
+            prevNode = currNode;
+            currNode = load_next(currNode);
+        }
+        if (!currNode) { //The value is not in the list.
+            break;
+        }
+
+        //Locking by list order (prev before curr), same as every other writer.
+        lock_node(list, prevNode);
+        list_lock_acquire(&(currNode->lock));
+        if (!is_marked(prevNode) && !is_marked(currNode) && prevNode->next == currNode &&
+            currNode->value == value) {
+            //Only 1 occurrence per call - marking first so readers skip it, then unlinking.
+            __atomic_store_n(&currNode->marked, 1, __ATOMIC_RELEASE);
+            __atomic_store_n(&prevNode->next, currNode->next, __ATOMIC_RELEASE);
+            list_lock_release(&(currNode->lock));
+            list_lock_release(&(prevNode->lock));
+            epoch_retire(&currNode->retire, destroy_node);
+            break;
+        }
+        list_lock_release(&(currNode->lock));
+        list_lock_release(&(prevNode->lock)); //Validation failed, searching again.
+    }
+    epoch_exit();
+}
+
+void insert_values(list *list, const int *values, size_t count) {
+    //Every insert searches without locks and locks only its own prev, so a sorted single pass would just
+    //hold locks longer - a batch is just a loop.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        insert_value(list, values[i]);
+    }
+}
+
+void remove_values(list *list, const int *values, size_t count) {
+    //Same as insert_values - every remove locks only its own prev and curr.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        remove_value(list, values[i]);
+    }
+}
+
+void print_list(list *list) {
+    if (!list) {
+        printf("\n");
+        return;
+    }
+
+    epoch_enter();
+    node *currNode = load_next(&list->head);
+    while (currNode) {
+        if (!is_marked(currNode)) { //Skipping logically deleted nodes.
+            print_node(currNode);
+        }
+        currNode = load_next(currNode);
+    }
+    epoch_exit();
+
+    printf("\n"); // DO NOT DELETE
+}
+
+void count_list(list *list, int (*predicate)(int)) {
+    int count = 0; // DO NOT DELETE
+
+    if (!list) {
+        printf("%d items were counted\n", 0);
+        return;
+    }
+
+    epoch_enter();
+    node *currNode = load_next(&list->head);
+    while (currNode) {
+        if (!is_marked(currNode) && predicate(load_value(currNode))) {
+            count++;
+        }
+        currNode = load_next(currNode);
+    }
+    epoch_exit();
+
+    printf("%d items were counted\n", count); // DO NOT DELETE
+}
+
+void swap_values(list *list, int val1, int val2) {
+    if (!list || val1 == val2) {
+        return;
+    }
+
+    epoch_enter();
+    while (1) {
+        node *firstNodePtr = NULL;
+        node *secondNodePtr = NULL;
+        node *lockFirst = NULL; //the one of the two we met first in the list.
+        node *currNode = load_next(&list->head);
+
+        //Finding the first live node of each value, without locks.
+        while (currNode && (!firstNodePtr || !secondNodePtr)) {
+            if (!is_marked(currNode)) {
+                int currValue = load_value(currNode);
+                if (currValue == val1 && !firstNodePtr) {
+                    firstNodePtr = currNode;
+                } else if (currValue == val2 && !secondNodePtr) {
+                    secondNodePtr = currNode;
+                }
+                if (!lockFirst) {
+                    lockFirst = firstNodePtr ? firstNodePtr : secondNodePtr;
+                }
+            }
+            currNode = load_next(currNode);
+        }
+
+        if (!firstNodePtr || !secondNodePtr) { //We can't switch if one of the values is missing.
+            break;
+        }
+
+        //Nodes never move, so locking the one we met first keeps the same list order as the other writers.
+        node *lockSecond = lockFirst == firstNodePtr ? secondNodePtr : firstNodePtr;
+
+        list_lock_acquire(&(lockFirst->lock));
+        list_lock_acquire(&(lockSecond->lock));
+        int valid = !is_marked(firstNodePtr) && !is_marked(secondNodePtr) &&
+                    firstNodePtr->value == val1 && secondNodePtr->value == val2;
+        if (valid) {
+            __atomic_store_n(&firstNodePtr->value, val2, __ATOMIC_RELAXED);
+            __atomic_store_n(&secondNodePtr->value, val1, __ATOMIC_RELAXED);
+        }
+        list_lock_release(&(lockSecond->lock));
+        list_lock_release(&(lockFirst->lock));
+        if (valid) {
+            break;
+        }
+    }
+    epoch_exit();
+}
+
+void swap_many(list *list, const int *pairs, size_t count) {
+    //Every swap locks only its own two nodes, so a batch is just a loop.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        swap_values(list, pairs[2 * i], pairs[2 * i + 1]);
+    }
+}
+
+static int read_range_count(list *list, int lo, int hi, int limit) {
+    //Same walk as count_list, but it stops as soon as it passes hi.
+    int count = 0;
+    epoch_enter();
+    node *currNode = load_next(&list->head);
+    while (currNode && count < limit) {
+        if (!is_marked(currNode)) {
+            int currValue = load_value(currNode);
+            if (currValue > hi) { //The list is sorted, nothing after this node.
+                break;
+            }
+            if (currValue >= lo) {
+                count++;
+            }
+        }
+        currNode = load_next(currNode);
+    }
+    epoch_exit();
+    return count;
+}
+
+int contains_value(list *list, int value) {
+    if (!list) {
+        return 0;
+    }
+    return read_range_count(list, value, value, 1);
+}
+
+int range_count(list *list, int lo, int hi) {
+    if (!list || lo > hi) {
+        return 0;
+    }
+    return read_range_count(list, lo, hi, INT_MAX);
+}
+
+void list_iter_begin(list *list, list_iter *iter) {
+    //The epoch stays entered until list_iter_end, so the nodes of the iteration are never freed.
+    iter->list = list;
+    iter->nextNode = NULL;
+    iter->index = 0;
+    iter->version = 0;
+    iter->valid = 1;
+    iter->locked = 0;
+    if (list) {
+        epoch_enter();
+        iter->nextNode = load_next(&list->head);
+    }
+}
+
+int list_iter_next(list_iter *iter, int *value) {
+    while (iter->nextNode) {
+        node *currNode = iter->nextNode;
+        iter->nextNode = load_next(currNode);
+        if (!is_marked(currNode)) { //Skipping logically deleted nodes.
+            *value = load_value(currNode);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int list_iter_end(list_iter *iter) {
+    if (iter->list) {
+        epoch_exit();
+    }
+    return 1;
+}
@@ -0,0 +1,438 @@
+#include <limits.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "concurrent_list.h"
+#include "epoch.h"
+
+//Lock-free sorted list (Harris / Michael).
+//A node is removed in two steps: first we mark the low bit of its next pointer (logical delete),
+//then we unlink it with a CAS on the previous link. Any CAS on a marked link fails, so an insert
+//can never attach a node after a node that is being removed.
+//Unlinked nodes are retired to the epoch reclamation (epoch.c), so threads that are still reading them are safe.
+//swap_values switches the values of two nodes in place (like concurrent_list), so after a swap the list is not
+//sorted any more. To change a value a thread first claims the node (second low bit of its next pointer):
+//a claimed node can't be marked and nothing can be linked after it, so its value and its place stay put
+//until the claim is dropped. remove_value claims its node too before it checks the value and marks it.
+
+#define MARK_BIT ((uintptr_t) 1)
+#define CLAIM_BIT ((uintptr_t) 2) //the node is claimed by a swap (or a remove), see claim_node.
+
+struct node {
+    int value; //Current node value.
+    uintptr_t next; //pointer to the next node, the low bit marks this node as logically deleted.
+    epoch_entry retire; //link for the epoch reclamation once the node was unlinked.
+};
+
+struct list {
+    uintptr_t head; //The head pointer of the list, never marked, 0 in case the list is empty.
+};
+
+static inline node *get_node(uintptr_t link) {
+    return (node *) (link & ~(MARK_BIT | CLAIM_BIT));
+}
+
+static inline int is_marked(uintptr_t link) {
+    return (int) (link & MARK_BIT);
+}
+
+static inline int is_claimed(uintptr_t link) {
+    return (int) (link & CLAIM_BIT);
+}
+
+static inline uintptr_t load_link(uintptr_t *link) {
+    return __atomic_load_n(link, __ATOMIC_ACQUIRE);
+}
+
+static inline int cas_link(uintptr_t *link, uintptr_t expected, uintptr_t desired) {
+    return __atomic_compare_exchange_n(link, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static inline int load_value(node *node) {
+    return __atomic_load_n(&node->value, __ATOMIC_RELAXED);
+}
+
+static void destroy_node(epoch_entry *entry) {
+    free((char *) entry - offsetof(node, retire));
+}
+
+void print_node(node *node) {
+    // DO NOT DELETE
+    if (node) {
+        printf("%d ", node->value);
+    }
+}
+
+/**
+ * Finds the position of a value, unlinking every marked node on the way.
+ * Must be called inside epoch_enter/epoch_exit.
+ * @param equal - 0 to stop at the first node > value (where insert_value puts it), 1 to stop at the first node
+ * with the value (swap_values may have moved it after bigger values).
+ * @param prevOut - the link that points to the returned node.
+ * @return the first matching node, or NULL if we got to the end of the list.
+ */
+static node *find(list *list, int value, int equal, uintptr_t **prevOut) {
+    uintptr_t *prev;
+    node *currNode;
+
+retry:
+    prev = &list->head;
+    currNode = get_node(load_link(prev));
+
+    while (currNode) {
+        uintptr_t next = load_link(&currNode->next);
+        if (is_marked(next)) {
+            //currNode is logically deleted, helping to unlink it, if prev changed (or is claimed) we start over.
+            if (!cas_link(prev, (uintptr_t) currNode, next & ~MARK_BIT)) {
+                goto retry;
+            }
+            epoch_retire(&currNode->retire, destroy_node);
+            currNode = get_node(next);
+            continue;
+        }
+
+        int currValue = load_value(currNode);
+        if (equal ? currValue == value : currValue > value) {
+            break;
+        }
+        prev = &currNode->next;
+        currNode = get_node(next);
+    }
+
+    *prevOut = prev;
+    return currNode;
+}
+
+/**
+ * Claims a node (sets CLAIM_BIT in its next), waiting while another thread holds the claim.
+ * Every CAS on a link expects it unclaimed, so until release_node the node can't be marked, nothing is linked
+ * after it and nobody else changes its value.
+ * @return 0 if the node was removed (marked) first.
+ */
+static int claim_node(node *node) {
+    while (1) {
+        uintptr_t next = load_link(&node->next);
+        if (is_marked(next)) {
+            return 0;
+        }
+        if (!is_claimed(next) && cas_link(&node->next, next, next | CLAIM_BIT)) {
+            return 1;
+        }
+        sched_yield(); //Claims are short, but the thread that holds it may be off the CPU.
+    }
+}
+
+static inline void release_node(node *node) {
+    //Nobody else changes a claimed link, a plain store is enough.
+    __atomic_store_n(&node->next, node->next & ~CLAIM_BIT, __ATOMIC_RELEASE);
+}
+
+list *create_list() {
+    list *newList = (list *) malloc(sizeof(list));
+    if (newList) {
+        newList->head = 0;
+    } else {
+        //Error with memory allocation (malloc).
+        perror("error");
+        exit(1);
+    }
+    return newList;
+}
+
+void delete_list(list *list) {
+    //No other thread may use the list anymore, so we free every node that is still linked (marked or not).
+    //Nodes that were already unlinked belong to the epoch reclamation.
+    if (!list) { //List is already NULL, nothing to delete.
+        return;
+    }
+
+    node *currNode = get_node(list->head);
+    free(list);
+
+    while (currNode) {
+        node *deleteNode = currNode;
+        currNode = get_node(currNode->next);
+        free(deleteNode);
+    }
+}
+
+list *create_list_from_sorted(const int *values, size_t count) {
+    //Nobody sees the list before we return it, so we just append every node at the end (O(n), no CAS).
+    size_t i;
+    for (i = 1; i < count; i++) {
+        if (values[i] < values[i - 1]) { //Not sorted after all, one insert per value.
+            list *newList = create_list();
+            insert_values(newList, values, count);
+            return newList;
+        }
+    }
+    list *newList = create_list();
+    uintptr_t *tail = &newList->head;
+    for (i = 0; i < count; i++) {
+        node *newNode = (node *) malloc(sizeof(node));
+        if (!newNode) { //Error with memory allocation (malloc)
+            perror("error");
+            exit(1);
+        }
+        newNode->value = values[i];
+        newNode->next = 0;
+        *tail = (uintptr_t) newNode;
+        tail = &newNode->next;
+    }
+    return newList;
+}
+
+void insert_value(list *list, int value) {
+    if (!list) {
+        return;
+    }
+    node *newNode = (node *) malloc(sizeof(node));
+    if (!newNode) { //Error with memory allocation (malloc)
+        perror("error");
+        exit(1);
+    }
+    newNode->value = value;
+
+    epoch_enter();
+    while (1) {
+        //Same value can repeat several times, the new node goes after all the equal values.
+        uintptr_t *prev;
+        node *currNode = find(list, value, 0, &prev);
+        newNode->next = (uintptr_t) currNode;
+        if (cas_link(prev, (uintptr_t) currNode, (uintptr_t) newNode)) {
+            break;
+        }
+    }
+    epoch_exit();
+}
+
+void remove_value(list *list, int value) {
+    if (!list) {
+        return;
+    }
+
+    epoch_enter();
+    while (1) {
+        uintptr_t *prev;
+        node *currNode = find(list, value, 1, &prev);
+        if (!currNode) { //The value is not in the list.
+            break;
+        }
+
+        //Claiming it first, so a swap can't change the value between our check and the mark.
+        if (!claim_node(currNode)) {
+            continue; //Another thread removed it first, searching again.
+        }
+        if (load_value(currNode) != value) {
+            release_node(currNode);
+            continue; //A swap changed it after we found it, searching again.
+        }
+        uintptr_t next = currNode->next & ~CLAIM_BIT;
+        __atomic_store_n(&currNode->next, next | MARK_BIT, __ATOMIC_RELEASE);
+
+        //The node is logically deleted (only 1 occurrence per call), now trying to unlink it.
+        if (cas_link(prev, (uintptr_t) currNode, next)) {
+            epoch_retire(&currNode->retire, destroy_node);
+        } else {
+            find(list, value, 1, &prev); //prev changed, find unlinks marked nodes for us.
+        }
+        break;
+    }
+    epoch_exit();
+}
+
+void insert_values(list *list, const int *values, size_t count) {
+    //Every insert is a single CAS next to its own position and takes no locks, so there is nothing
+    //to share between the values of a batch - a batch is just a loop.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        insert_value(list, values[i]);
+    }
+}
+
+void remove_values(list *list, const int *values, size_t count) {
+    //Same as insert_values - every value is removed with its own CASes.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        remove_value(list, values[i]);
+    }
+}
+
+void print_list(list *list) {
+    if (!list) {
+        printf("\n");
+        return;
+    }
+
+    epoch_enter();
+    node *currNode = get_node(load_link(&list->head));
+    while (currNode) {
+        uintptr_t next = load_link(&currNode->next);
+        if (!is_marked(next)) { //Skipping logically deleted nodes.
+            print_node(currNode);
+        }
+        currNode = get_node(next);
+    }
+    epoch_exit();
+
+    printf("\n"); // DO NOT DELETE
+}
+
+void count_list(list *list, int (*predicate)(int)) {
+    int count = 0; // DO NOT DELETE
+
+    if (!list) {
+        printf("%d items were counted\n", 0);
+        return;
+    }
+
+    epoch_enter();
+    node *currNode = get_node(load_link(&list->head));
+    while (currNode) {
+        uintptr_t next = load_link(&currNode->next);
+        if (!is_marked(next) && predicate(load_value(currNode))) {
+            count++;
+        }
+        currNode = get_node(next);
+    }
+    epoch_exit();
+
+    printf("%d items were counted\n", count); // DO NOT DELETE
+}
+
+void swap_values(list *list, int val1, int val2) {
+    if (!list || val1 == val2) {
+        return;
+    }
+
+    epoch_enter();
+    while (1) {
+        node *firstNodePtr = NULL;
+        node *secondNodePtr = NULL;
+        node *claimFirst = NULL; //the one of the two we met first in the list.
+        node *currNode = get_node(load_link(&list->head));
+
+        //Finding the first live node of each value.
+        while (currNode && (!firstNodePtr || !secondNodePtr)) {
+            uintptr_t next = load_link(&currNode->next);
+            if (!is_marked(next)) {
+                int currValue = load_value(currNode);
+                if (currValue == val1 && !firstNodePtr) {
+                    firstNodePtr = currNode;
+                } else if (currValue == val2 && !secondNodePtr) {
+                    secondNodePtr = currNode;
+                }
+                if (!claimFirst) {
+                    claimFirst = firstNodePtr ? firstNodePtr : secondNodePtr;
+                }
+            }
+            currNode = get_node(next);
+        }
+
+        if (!firstNodePtr || !secondNodePtr) { //We can't switch if one of the values is missing.
+            break;
+        }
+
+        //Nodes never move and a claimed node stays linked, so claiming in list order can't deadlock with
+        //another swap. Once we hold both, the values are ours to switch (a reader may see one of them switched).
+        node *claimSecond = claimFirst == firstNodePtr ? secondNodePtr : firstNodePtr;
+        if (!claim_node(claimFirst)) {
+            continue;
+        }
+        if (!claim_node(claimSecond)) {
+            release_node(claimFirst);
+            continue;
+        }
+        int valid = load_value(firstNodePtr) == val1 && load_value(secondNodePtr) == val2;
+        if (valid) {
+            __atomic_store_n(&firstNodePtr->value, val2, __ATOMIC_RELAXED);
+            __atomic_store_n(&secondNodePtr->value, val1, __ATOMIC_RELAXED);
+        }
+        release_node(claimSecond);
+        release_node(claimFirst);
+        if (valid) {
+            break;
+        }
+    }
+    epoch_exit();
+}
+
+void swap_many(list *list, const int *pairs, size_t count) {
+    //Every swap claims only its own two nodes, so a batch is just a loop.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        swap_values(list, pairs[2 * i], pairs[2 * i + 1]);
+    }
+}
+
+static int read_range_count(list *list, int lo, int hi, int limit) {
+    //Under an epoch, so the nodes we walk on are never freed, marked nodes are skipped.
+    int count = 0;
+    epoch_enter();
+    node *currNode = get_node(load_link(&list->head));
+    while (currNode && count < limit) {
+        uintptr_t next = load_link(&currNode->next);
+        if (!is_marked(next)) {
+            int currValue = load_value(currNode);
+            if (currValue > hi) { //The list is sorted, nothing after this node.
+                break;
+            }
+            if (currValue >= lo) {
+                count++;
+            }
+        }
+        currNode = get_node(next);
+    }
+    epoch_exit();
+    return count;
+}
+
+int contains_value(list *list, int value) {
+    if (!list) {
+        return 0;
+    }
+    return read_range_count(list, value, value, 1);
+}
+
+int range_count(list *list, int lo, int hi) {
+    if (!list || lo > hi) {
+        return 0;
+    }
+    return read_range_count(list, lo, hi, INT_MAX);
+}
+
+void list_iter_begin(list *list, list_iter *iter) {
+    //The epoch stays entered until list_iter_end, so the nodes of the iteration are never freed.
+    iter->list = list;
+    iter->nextNode = NULL;
+    iter->index = 0;
+    iter->version = 0;
+    iter->valid = 1;
+    iter->locked = 0;
+    if (list) {
+        epoch_enter();
+        iter->nextNode = get_node(load_link(&list->head));
+    }
+}
+
+int list_iter_next(list_iter *iter, int *value) {
+    while (iter->nextNode) {
+        node *currNode = iter->nextNode;
+        uintptr_t next = load_link(&currNode->next);
+        iter->nextNode = get_node(next);
+        if (!is_marked(next)) { //Skipping logically deleted nodes.
+            *value = load_value(currNode);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int list_iter_end(list_iter *iter) {
+    if (iter->list) {
+        epoch_exit();
+    }
+    return 1;
+}
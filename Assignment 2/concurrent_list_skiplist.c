@@ -0,0 +1,584 @@
+#include <limits.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "concurrent_list.h"
+#include "epoch.h"
+#include "list_lock.h"
+
+//Concurrent skip list (lazy, lock-based - Herlihy, Lev, Luchangco, Shavit).
+//Search is lock-free, writers lock only the predecessors they change and validate them, so every
+//operation is O(log n) expected instead of walking the whole list.
+//The same value can repeat several times, so the real key of a node is (key, id), where key is the value it was
+//inserted with and id is a unique insertion number. A new value goes after all the equal values (like the list),
+//and remove_value removes the first occurrence. Unlinked nodes are retired to the epoch reclamation (epoch.c).
+//swap_values switches the values of two nodes in place (like concurrent_list) and keeps their keys, so the levels
+//stay in key order. After the first swap the values are not sorted any more, and the list works like the lazy
+//list on level 0: remove_value, swap_values and the queries walk level 0, and insert_value links the new node
+//in level 0 only, before the first bigger value. The levels above only get the nodes of the sorted inserts.
+
+#define MAX_LEVEL 24 //enough for 2^24 values with p = 1/2.
+
+struct node {
+    int value; //Current node value.
+    int key; //the value the node was inserted with, never changes (the order of the levels).
+    unsigned long id; //insertion number, makes equal values unique.
+    int topLevel; //highest level this node is linked in.
+    int marked; //1 once the node was logically deleted.
+    int fullyLinked; //1 once the node was linked in all its levels.
+    list_lock lock; //the lock for the node (the lock policy is selected at build time, see list_lock.h).
+    epoch_entry retire; //link for the epoch reclamation once the node was unlinked.
+    node *next[]; //next node in every level (topLevel + 1 pointers).
+};
+
+struct list {
+    node *head; //Sentinel node with MAX_LEVEL pointers, it is smaller than every value.
+    unsigned long nextId; //next insertion number.
+    int unsorted; //1 after the first swap_values, the values don't follow the keys any more.
+};
+
+static __thread unsigned int randomState = 0;
+
+static int random_level() {
+    //xorshift per thread, the level is the number of trailing zero bits (p = 1/2 for every level).
+    if (!randomState) {
+        randomState = (unsigned int) (size_t) &randomState | 1;
+    }
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return __builtin_ctz(randomState | (1u << (MAX_LEVEL - 1)));
+}
+
+static inline node *load_next(node *node, int level) {
+    return __atomic_load_n(&node->next[level], __ATOMIC_ACQUIRE);
+}
+
+static inline int is_marked(node *node) {
+    return __atomic_load_n(&node->marked, __ATOMIC_ACQUIRE);
+}
+
+static inline int is_live(node *node) {
+    return __atomic_load_n(&node->fullyLinked, __ATOMIC_ACQUIRE) && !is_marked(node);
+}
+
+static inline int key_less(node *node, int key, unsigned long id) {
+    return node->key < key || (node->key == key && node->id < id);
+}
+
+static inline int load_value(node *node) {
+    return __atomic_load_n(&node->value, __ATOMIC_RELAXED);
+}
+
+static inline int is_unsorted(list *list) {
+    return __atomic_load_n(&list->unsorted, __ATOMIC_ACQUIRE);
+}
+
+static node *create_node(int value, unsigned long id, int topLevel) {
+    node *newNode = (node *) malloc(sizeof(node) + (topLevel + 1) * sizeof(node *));
+    if (!newNode) { //Error with memory allocation (malloc)
+        perror("error");
+        exit(1);
+    }
+    newNode->value = value;
+    newNode->key = value;
+    newNode->id = id;
+    newNode->topLevel = topLevel;
+    newNode->marked = 0;
+    newNode->fullyLinked = 0;
+    if (list_lock_init(&(newNode->lock)) != 0) {
+        free(newNode);
+        return NULL;
+    }
+    return newNode;
+}
+
+static void free_node(node *node) {
+    list_lock_destroy(&(node->lock));
+    free(node);
+}
+
+static void destroy_node(epoch_entry *entry) {
+    free_node((node *) ((char *) entry - offsetof(node, retire)));
+}
+
+static inline void lock_node(list *list, node *node) {
+    //The head sentinel is counted as the list head in the lock statistics (see list_stats.h).
+    if (node == list->head) {
+        list_lock_acquire_head(&(node->lock));
+    } else {
+        list_lock_acquire(&(node->lock));
+    }
+}
+
+/**
+ * Fills preds/succs for the key (key, id) in every level, without locks.
+ * Must be called inside epoch_enter/epoch_exit.
+ */
+static void find(list *list, int key, unsigned long id, node **preds, node **succs) {
+    node *prevNode = list->head;
+    int level;
+    for (level = MAX_LEVEL - 1; level >= 0; level--) {
+        node *currNode = load_next(prevNode, level);
+        while (currNode && key_less(currNode, key, id)) {
+            prevNode = currNode;
+            currNode = load_next(prevNode, level);
+        }
+        preds[level] = prevNode;
+        succs[level] = currNode;
+    }
+}
+
+static node *find_value(list *list, int value) {
+    //The first live node of the value on level 0, for a list that swap_values left unsorted.
+    node *currNode = load_next(list->head, 0);
+    while (currNode && (!is_live(currNode) || load_value(currNode) != value)) {
+        currNode = load_next(currNode, 0);
+    }
+    return currNode;
+}
+
+static void find_preds(list *list, node *victim, node **preds, node **succs) {
+    //The levels above 0 are in key order, but level 0 of an unsorted list is not (the level 0 only inserts),
+    //so there we walk to the node that points to victim.
+    find(list, victim->key, victim->id, preds, succs);
+    if (is_unsorted(list)) {
+        node *prevNode = list->head;
+        node *currNode = load_next(prevNode, 0);
+        while (currNode && currNode != victim) {
+            prevNode = currNode;
+            currNode = load_next(currNode, 0);
+        }
+        preds[0] = prevNode; //If we missed victim, the validation fails and we look again.
+    }
+}
+
+static void unlock_preds(node **preds, int topLevel) {
+    int level;
+    node *prevNode = NULL;
+    for (level = 0; level <= topLevel; level++) {
+        if (preds[level] != prevNode) { //The same node can be the pred in several levels, it was locked once.
+            list_lock_release(&(preds[level]->lock));
+            prevNode = preds[level];
+        }
+    }
+}
+
+void print_node(node *node) {
+    // DO NOT DELETE
+    if (node) {
+        printf("%d ", node->value);
+    }
+}
+
+list *create_list() {
+    list *newList = (list *) malloc(sizeof(list));
+    if (!newList) {
+        //Error with memory allocation (malloc).
+        perror("error");
+        exit(1);
+    }
+    newList->head = create_node(0, 0, MAX_LEVEL - 1);
+    if (!newList->head) {
+        free(newList);
+        return NULL;
+    }
+    int level;
+    for (level = 0; level < MAX_LEVEL; level++) {
+        newList->head->next[level] = NULL;
+    }
+    newList->head->fullyLinked = 1;
+    newList->nextId = 1; //ids start from 1, so (value, 0) is smaller than every occurrence of value.
+    newList->unsorted = 0;
+    return newList;
+}
+
+void delete_list(list *list) {
+    //No other thread may use the list anymore, every node is linked in level 0.
+    if (!list) { //List is already NULL, nothing to delete.
+        return;
+    }
+
+    node *currNode = list->head;
+    free(list);
+
+    while (currNode) {
+        node *deleteNode = currNode;
+        currNode = currNode->next[0];
+        free_node(deleteNode);
+    }
+}
+
+list *create_list_from_sorted(const int *values, size_t count) {
+    //Nobody sees the list before we return it, so every node is appended after the last node of each
+    //of its levels (O(n) in total, no search and no locks).
+    size_t i;
+    for (i = 1; i < count; i++) {
+        if (values[i] < values[i - 1]) { //Not sorted after all, one insert per value.
+            list *newList = create_list();
+            insert_values(newList, values, count);
+            return newList;
+        }
+    }
+    list *newList = create_list();
+    if (!newList) {
+        return NULL;
+    }
+    node *lastNodes[MAX_LEVEL];
+    int level;
+    for (level = 0; level < MAX_LEVEL; level++) {
+        lastNodes[level] = newList->head;
+    }
+    for (i = 0; i < count; i++) {
+        int topLevel = random_level();
+        node *newNode = create_node(values[i], newList->nextId++, topLevel);
+        if (!newNode) {
+            continue;
+        }
+        for (level = 0; level <= topLevel; level++) {
+            newNode->next[level] = NULL;
+            lastNodes[level]->next[level] = newNode;
+            lastNodes[level] = newNode;
+        }
+        newNode->fullyLinked = 1;
+    }
+    return newList;
+}
+
+void insert_value(list *list, int value) {
+    if (!list) {
+        return;
+    }
+    node *preds[MAX_LEVEL];
+    node *succs[MAX_LEVEL];
+    int topLevel = random_level();
+    //A bigger id than every existing occurrence, so the new node goes after all the equal values.
+    unsigned long id = __atomic_fetch_add(&list->nextId, 1, __ATOMIC_RELAXED);
+
+    node *newNode = create_node(value, id, topLevel);
+    if (!newNode) {
+        return;
+    }
+
+    epoch_enter();
+    while (1) {
+        if (is_unsorted(list)) {
+            //Like the lazy list - before the first bigger value of level 0, and only there.
+            newNode->topLevel = 0;
+            node *prevNode = list->head;
+            node *currNode = load_next(prevNode, 0);
+            while (currNode && load_value(currNode) <= value) {
+                prevNode = currNode;
+                currNode = load_next(currNode, 0);
+            }
+            lock_node(list, prevNode);
+            if (!is_marked(prevNode) && prevNode->next[0] == currNode) {
+                newNode->next[0] = currNode;
+                __atomic_store_n(&prevNode->next[0], newNode, __ATOMIC_RELEASE);
+                __atomic_store_n(&newNode->fullyLinked, 1, __ATOMIC_RELEASE);
+                list_lock_release(&(prevNode->lock));
+                break;
+            }
+            list_lock_release(&(prevNode->lock)); //Validation failed, searching again.
+            continue;
+        }
+        find(list, value, id, preds, succs);
+
+        //Locking the preds from the bottom up (from the biggest key down), same order as remove_value.
+        int level;
+        int valid = 1;
+        node *prevNode = NULL;
+        for (level = 0; valid && level <= topLevel; level++) {
+            if (preds[level] != prevNode) {
+                lock_node(list, preds[level]);
+                prevNode = preds[level];
+            }
+            valid = !is_marked(preds[level]) && (!succs[level] || !is_marked(succs[level])) &&
+                    preds[level]->next[level] == succs[level];
+        }
+        if (!valid) {
+            unlock_preds(preds, level - 1); //Validation failed, searching again.
+            continue;
+        }
+
+        for (level = 0; level <= topLevel; level++) {
+            newNode->next[level] = succs[level];
+        }
+        for (level = 0; level <= topLevel; level++) {
+            __atomic_store_n(&preds[level]->next[level], newNode, __ATOMIC_RELEASE);
+        }
+        __atomic_store_n(&newNode->fullyLinked, 1, __ATOMIC_RELEASE);
+        unlock_preds(preds, topLevel);
+        break;
+    }
+    epoch_exit();
+}
+
+void remove_value(list *list, int value) {
+    if (!list) {
+        return;
+    }
+    node *preds[MAX_LEVEL];
+    node *succs[MAX_LEVEL];
+    node *victim = NULL;
+
+    epoch_enter();
+    while (1) {
+        if (!victim) {
+            int unsorted = is_unsorted(list);
+            node *currNode;
+            if (unsorted) {
+                currNode = find_value(list, value);
+            } else {
+                //(value, 0) is smaller than every occurrence, so succs[0] is the first occurrence.
+                find(list, value, 0, preds, succs);
+                currNode = succs[0] && succs[0]->key == value ? succs[0] : NULL;
+            }
+            if (!currNode) { //The value is not in the list.
+                if (!unsorted && is_unsorted(list)) {
+                    continue; //A swap began while we looked, the value may be somewhere else now.
+                }
+                break;
+            }
+            if (!is_live(currNode)) {
+                continue; //Being inserted or removed by another thread right now, searching again.
+            }
+            list_lock_acquire(&(currNode->lock));
+            if (is_marked(currNode) || currNode->value != value) { //Removed, or a swap changed it.
+                list_lock_release(&(currNode->lock));
+                continue;
+            }
+            //Only 1 occurrence per call - we own it from now on, readers skip it.
+            __atomic_store_n(&currNode->marked, 1, __ATOMIC_RELEASE);
+            victim = currNode;
+            if (unsorted) {
+                find_preds(list, victim, preds, succs);
+            }
+        } else {
+            find_preds(list, victim, preds, succs);
+        }
+
+        //victim stays locked while we lock and validate its preds (the nodes before it on level 0, from the
+        //nearest one, same order as insert_value and swap_values).
+        int level;
+        int valid = 1;
+        node *prevNode = NULL;
+        for (level = 0; valid && level <= victim->topLevel; level++) {
+            if (preds[level] != prevNode) {
+                lock_node(list, preds[level]);
+                prevNode = preds[level];
+            }
+            valid = !is_marked(preds[level]) && preds[level]->next[level] == victim;
+        }
+        if (!valid) {
+            unlock_preds(preds, level - 1); //Validation failed, searching again.
+            continue;
+        }
+
+        for (level = victim->topLevel; level >= 0; level--) {
+            __atomic_store_n(&preds[level]->next[level], victim->next[level], __ATOMIC_RELEASE);
+        }
+        list_lock_release(&(victim->lock));
+        unlock_preds(preds, victim->topLevel);
+        epoch_retire(&victim->retire, destroy_node);
+        break;
+    }
+    epoch_exit();
+}
+
+void insert_values(list *list, const int *values, size_t count) {
+    //Every insert is O(log n) and locks only its own preds, a merge pass over level 0 would be O(n),
+    //so a batch is just a loop.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        insert_value(list, values[i]);
+    }
+}
+
+void remove_values(list *list, const int *values, size_t count) {
+    //Same as insert_values - every remove is O(log n) on its own.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        remove_value(list, values[i]);
+    }
+}
+
+void print_list(list *list) {
+    if (!list) {
+        printf("\n");
+        return;
+    }
+
+    epoch_enter();
+    node *currNode = load_next(list->head, 0);
+    while (currNode) {
+        if (is_live(currNode)) {
+            print_node(currNode);
+        }
+        currNode = load_next(currNode, 0);
+    }
+    epoch_exit();
+
+    printf("\n"); // DO NOT DELETE
+}
+
+void count_list(list *list, int (*predicate)(int)) {
+    int count = 0; // DO NOT DELETE
+
+    if (!list) {
+        printf("%d items were counted\n", 0);
+        return;
+    }
+
+    epoch_enter();
+    node *currNode = load_next(list->head, 0);
+    while (currNode) {
+        if (is_live(currNode) && predicate(load_value(currNode))) {
+            count++;
+        }
+        currNode = load_next(currNode, 0);
+    }
+    epoch_exit();
+
+    printf("%d items were counted\n", count); // DO NOT DELETE
+}
+
+void swap_values(list *list, int val1, int val2) {
+    if (!list || val1 == val2) {
+        return;
+    }
+
+    epoch_enter();
+    if (!is_unsorted(list)) {
+        //From now on the values don't follow the keys (before we change any value, see remove_value).
+        __atomic_store_n(&list->unsorted, 1, __ATOMIC_SEQ_CST);
+    }
+    while (1) {
+        node *firstNodePtr = NULL;
+        node *secondNodePtr = NULL;
+        node *metSecond = NULL; //the one of the two we met last on level 0.
+        node *currNode = load_next(list->head, 0);
+
+        //Finding the first live node of each value, without locks.
+        while (currNode && (!firstNodePtr || !secondNodePtr)) {
+            if (is_live(currNode)) {
+                int currValue = load_value(currNode);
+                if (currValue == val1 && !firstNodePtr) {
+                    firstNodePtr = currNode;
+                    metSecond = currNode;
+                } else if (currValue == val2 && !secondNodePtr) {
+                    secondNodePtr = currNode;
+                    metSecond = currNode;
+                }
+            }
+            currNode = load_next(currNode, 0);
+        }
+
+        if (!firstNodePtr || !secondNodePtr) { //We can't switch if one of the values is missing.
+            break;
+        }
+
+        //Everybody locks from the later node on level 0 to the earlier one (a remove locks its node and then
+        //its preds), and nodes never move on level 0, so we lock the one we met last first.
+        node *metFirst = metSecond == firstNodePtr ? secondNodePtr : firstNodePtr;
+        list_lock_acquire(&(metSecond->lock));
+        list_lock_acquire(&(metFirst->lock));
+        int valid = is_live(firstNodePtr) && is_live(secondNodePtr) && firstNodePtr->value == val1 &&
+                    secondNodePtr->value == val2;
+        if (valid) {
+            __atomic_store_n(&firstNodePtr->value, val2, __ATOMIC_RELAXED);
+            __atomic_store_n(&secondNodePtr->value, val1, __ATOMIC_RELAXED);
+        }
+        list_lock_release(&(metFirst->lock));
+        list_lock_release(&(metSecond->lock));
+        if (valid) {
+            break;
+        }
+    }
+    epoch_exit();
+}
+
+void swap_many(list *list, const int *pairs, size_t count) {
+    //Every swap locks only its own two nodes, so a batch is just a loop.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        swap_values(list, pairs[2 * i], pairs[2 * i + 1]);
+    }
+}
+
+static int read_range_count(list *list, int lo, int hi, int limit) {
+    //find goes down the levels to the first occurrence of lo in O(log n), from there we walk level 0.
+    //After a swap the keys don't tell where lo is, so we walk level 0 from the start (like the lazy list).
+    node *preds[MAX_LEVEL];
+    node *succs[MAX_LEVEL];
+    int count = 0;
+    epoch_enter();
+    node *currNode;
+    if (is_unsorted(list)) {
+        currNode = load_next(list->head, 0);
+    } else {
+        find(list, lo, 0, preds, succs);
+        currNode = succs[0];
+    }
+    while (currNode && count < limit) {
+        if (is_live(currNode)) {
+            int currValue = load_value(currNode);
+            if (currValue > hi) { //The list is sorted, nothing after this node.
+                break;
+            }
+            if (currValue >= lo) {
+                count++;
+            }
+        }
+        currNode = load_next(currNode, 0);
+    }
+    epoch_exit();
+    return count;
+}
+
+int contains_value(list *list, int value) {
+    if (!list) {
+        return 0;
+    }
+    return read_range_count(list, value, value, 1);
+}
+
+int range_count(list *list, int lo, int hi) {
+    if (!list || lo > hi) {
+        return 0;
+    }
+    return read_range_count(list, lo, hi, INT_MAX);
+}
+
+void list_iter_begin(list *list, list_iter *iter) {
+    //The epoch stays entered until list_iter_end, so the nodes of the iteration are never freed.
+    iter->list = list;
+    iter->nextNode = NULL;
+    iter->index = 0;
+    iter->version = 0;
+    iter->valid = 1;
+    iter->locked = 0;
+    if (list) {
+        epoch_enter();
+        iter->nextNode = load_next(list->head, 0);
+    }
+}
+
+int list_iter_next(list_iter *iter, int *value) {
+    while (iter->nextNode) {
+        node *currNode = iter->nextNode;
+        iter->nextNode = load_next(currNode, 0);
+        if (is_live(currNode)) { //Skipping nodes that are being inserted or removed.
+            *value = load_value(currNode);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int list_iter_end(list_iter *iter) {
+    if (iter->list) {
+        epoch_exit();
+    }
+    return 1;
+}
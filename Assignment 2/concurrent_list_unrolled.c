@@ -0,0 +1,843 @@
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "concurrent_list.h"
+#include "list_lock.h"
+#include "node_pool.h"
+
+//Unrolled (chunked) sorted list.
+//Every node is a chunk of up to CHUNK_CAPACITY sorted values with one lock, so a traversal follows one
+//pointer per chunk instead of one per value. With LOCK=SPIN or LOCK=TICKET a chunk is exactly one 64 byte line.
+//The values are sorted inside the chunks and across them (the same value can span chunks), until swap_values
+//switches two values in place (like concurrent_list) - after that remove_value looks at every chunk.
+//The chunk search compares the whole chunk at once with SSE2/AVX2 (build with ARCH_FLAGS=-mavx2 for the AVX2
+//kernel), with a plain loop on other CPUs, and gives a bit per value, so it works on an unsorted chunk too.
+//Chunks are hand over hand locked from the head sentinel, a full chunk is split in two on insert
+//and a chunk that gets almost empty on remove is merged with the next one.
+//The read only queries take no locks, they copy every chunk and validate the copies with a seqlock
+//(same scheme as concurrent_list.c).
+
+#define CHUNK_CAPACITY 12
+#define CHUNK_MERGE_THRESHOLD (CHUNK_CAPACITY / 4) //merge with the next chunk when we get below this.
+#define READ_TRIES 3 //lock-free tries of a query (or a swap) before it falls back to the chunk locks.
+#define ITER_TRIES 3 //iterations that weren't a snapshot in a row before the next one takes the whole list.
+#define BUILD_FILL (CHUNK_CAPACITY - CHUNK_CAPACITY / 4) //values per chunk of create_list_from_sorted (room for inserts).
+#define BUILD_PARALLEL_MIN (1 << 16) //create_list_from_sorted uses several threads from this many values.
+#define BUILD_UNITS_PER_THREAD 4
+
+struct node {
+    int values[CHUNK_CAPACITY]; //sorted values of the chunk.
+    int count; //values in use, never 0 (except for the head sentinel).
+    list_lock lock; //the lock for the chunk (see list_lock.h).
+    node *next; //pointer to the next chunk.
+};
+
+struct list {
+    node head; //Sentinel chunk with no values, its lock is the list lock and head.next is the first chunk.
+    node_pool *pool; //every chunk of the list comes from this pool, with its lock already initialized.
+    //Seqlock for the lock-free readers, every change of a chunk is done between write_begin and write_end.
+    unsigned long writesStarted;
+    unsigned long writesDone;
+    int unsorted; //1 after the first swap_values, the values may be out of order from then on.
+};
+
+static inline unsigned int count_mask(const node *chunk) {
+    return (1u << chunk->count) - 1;
+}
+
+/**
+ * Bit i is set if values[i] is smaller than value (orEqual = 0) or smaller or equal (orEqual = 1),
+ * for the count values in use. In a sorted chunk the number of bits is the position of the first
+ * value >= value (or > value).
+ */
+static inline unsigned int chunk_mask(const node *chunk, int value, int orEqual) {
+#if defined(__AVX2__) || defined(__SSE2__)
+    //We compare all the CHUNK_CAPACITY slots at once and mask out the ones after count.
+    //orEqual: x <= value is x < value + 1 (value + 1 can't overflow, INT_MAX is bigger or equal to everything).
+    if (orEqual && value == 0x7fffffff) {
+        return count_mask(chunk);
+    }
+    int bound = orEqual ? value + 1 : value;
+    unsigned int mask;
+#if defined(__AVX2__)
+    __m256i key8 = _mm256_set1_epi32(bound);
+    __m128i key4 = _mm_set1_epi32(bound);
+    __m256i low = _mm256_cmpgt_epi32(key8, _mm256_loadu_si256((const __m256i *) chunk->values));
+    __m128i high = _mm_cmpgt_epi32(key4, _mm_loadu_si128((const __m128i *) (chunk->values + 8)));
+    mask = (unsigned int) _mm256_movemask_ps(_mm256_castsi256_ps(low)) |
+           ((unsigned int) _mm_movemask_ps(_mm_castsi128_ps(high)) << 8);
+#else
+    __m128i key = _mm_set1_epi32(bound);
+    __m128i a = _mm_cmpgt_epi32(key, _mm_loadu_si128((const __m128i *) chunk->values));
+    __m128i b = _mm_cmpgt_epi32(key, _mm_loadu_si128((const __m128i *) (chunk->values + 4)));
+    __m128i c = _mm_cmpgt_epi32(key, _mm_loadu_si128((const __m128i *) (chunk->values + 8)));
+    mask = (unsigned int) _mm_movemask_ps(_mm_castsi128_ps(a)) |
+           ((unsigned int) _mm_movemask_ps(_mm_castsi128_ps(b)) << 4) |
+           ((unsigned int) _mm_movemask_ps(_mm_castsi128_ps(c)) << 8);
+#endif
+    return mask & count_mask(chunk);
+#else
+    unsigned int mask = 0;
+    int i;
+    for (i = 0; i < chunk->count; i++) {
+        if (orEqual ? chunk->values[i] <= value : chunk->values[i] < value) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+#endif
+}
+
+static inline unsigned int chunk_equal(const node *chunk, int value) {
+    return chunk_mask(chunk, value, 1) & ~chunk_mask(chunk, value, 0);
+}
+
+static inline int first_bit(unsigned int mask, int none) {
+    return mask ? __builtin_ctz(mask) : none;
+}
+
+/**
+ * Counts the values v with lo <= v <= hi of the chunk that come before its first value > hi.
+ * @return 1 if the chunk has a value > hi (the list is sorted, nothing after it is in the range).
+ */
+static inline int chunk_range(const node *chunk, int lo, int hi, int *count) {
+    unsigned int upTo = chunk_mask(chunk, hi, 1);
+    int stop = first_bit(~upTo & count_mask(chunk), chunk->count);
+    *count += __builtin_popcount(upTo & ~chunk_mask(chunk, lo, 0) & ((1u << stop) - 1));
+    return stop < chunk->count;
+}
+
+static void init_node(void *object) {
+    //Called once per chunk when the pool creates it, the lock stays initialized while the chunk is reused.
+    if (list_lock_init(&(((node *) object)->lock)) != 0) {
+        perror("error");
+        exit(1);
+    }
+}
+
+static void destroy_node(void *object) {
+    list_lock_destroy(&(((node *) object)->lock));
+}
+
+//Lock-free readers may read a chunk at any time (even a freed one), so the writers store with atomics.
+static inline void set_value(node *chunk, int pos, int value) {
+    __atomic_store_n(&chunk->values[pos], value, __ATOMIC_RELAXED);
+}
+
+static inline void set_count(node *chunk, int count) {
+    __atomic_store_n(&chunk->count, count, __ATOMIC_RELAXED);
+}
+
+static inline void set_next(node *chunk, node *next) {
+    __atomic_store_n(&chunk->next, next, __ATOMIC_RELAXED);
+}
+
+static inline node *load_next(node *chunk) {
+    return __atomic_load_n(&chunk->next, __ATOMIC_RELAXED);
+}
+
+static inline void write_begin(list *list) {
+    __atomic_fetch_add(&list->writesStarted, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void write_end(list *list) {
+    __atomic_fetch_add(&list->writesDone, 1, __ATOMIC_RELEASE);
+}
+
+static inline int read_begin(list *list, unsigned long *version) {
+    unsigned long done = __atomic_load_n(&list->writesDone, __ATOMIC_ACQUIRE);
+    *version = __atomic_load_n(&list->writesStarted, __ATOMIC_ACQUIRE);
+    return *version == done;
+}
+
+static inline int read_validate(list *list, unsigned long version) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&list->writesStarted, __ATOMIC_RELAXED) == version;
+}
+
+/**
+ * Copies a chunk without its lock, the copy is only good if read_validate passes after it.
+ * The count is clamped, so even a copy of a chunk that was reused under us is safe to search.
+ */
+static void copy_chunk(node *chunk, node *copy) {
+    int count = __atomic_load_n(&chunk->count, __ATOMIC_RELAXED);
+    copy->count = count < 0 ? 0 : (count > CHUNK_CAPACITY ? CHUNK_CAPACITY : count);
+    int i;
+    for (i = 0; i < CHUNK_CAPACITY; i++) {
+        copy->values[i] = __atomic_load_n(&chunk->values[i], __ATOMIC_RELAXED);
+    }
+}
+
+static node *create_chunk(list *list, node *next) {
+    node *newChunk = (node *) node_pool_alloc(list->pool);
+    set_count(newChunk, 0);
+    set_next(newChunk, next);
+    return newChunk;
+}
+
+static void insert_at(list *list, node *chunk, int pos, int value) {
+    //chunk is locked by us, if it is full we split it in half first, the new chunk goes right after it.
+    if (chunk->count == CHUNK_CAPACITY) {
+        node *newChunk = create_chunk(list, chunk->next);
+        int half = CHUNK_CAPACITY / 2;
+        int i;
+        for (i = half; i < CHUNK_CAPACITY; i++) {
+            set_value(newChunk, i - half, chunk->values[i]);
+        }
+        set_count(newChunk, CHUNK_CAPACITY - half);
+        set_count(chunk, half);
+        set_next(chunk, newChunk); //nobody can reach newChunk before we unlock chunk.
+        if (pos > half) {
+            chunk = newChunk;
+            pos -= half;
+        }
+    }
+
+    int i;
+    for (i = chunk->count; i > pos; i--) {
+        set_value(chunk, i, chunk->values[i - 1]);
+    }
+    set_value(chunk, pos, value);
+    set_count(chunk, chunk->count + 1);
+}
+
+void print_node(node *node) {
+    // DO NOT DELETE
+    if (node) {
+        int i;
+        for (i = 0; i < node->count; i++) {
+            printf("%d ", node->values[i]);
+        }
+    }
+}
+
+list *create_list() {
+    list *newList = (list *) malloc(sizeof(list));
+    if (newList) {
+        newList->head.count = 0;
+        newList->head.next = NULL;
+        newList->writesStarted = 0;
+        newList->writesDone = 0;
+        newList->unsorted = 0;
+    } else {
+        //Error with memory allocation (malloc).
+        perror("error");
+        exit(1);
+    }
+    if (list_lock_init(&(newList->head.lock)) != 0) {
+        free(newList);
+        return NULL;
+    }
+    newList->pool = node_pool_create(sizeof(node), offsetof(node, next), init_node,
+                                     LIST_LOCK_NEEDS_DESTROY ? destroy_node : NULL);
+    if (!newList->pool) {
+        list_lock_destroy(&(newList->head.lock));
+        free(newList);
+        return NULL;
+    }
+    return newList;
+}
+
+void delete_list(list *list) {
+    //Every chunk lives in the list pool, so we release the whole pool at once.
+    if (!list) { //List is already NULL, nothing to delete.
+        return;
+    }
+
+    list_lock_acquire_head(&(list->head.lock));
+    list->head.next = NULL;
+    list_lock_release(&(list->head.lock));
+    list_lock_destroy(&(list->head.lock));
+
+    node_pool_delete(list->pool);
+    free(list);
+}
+
+typedef struct {
+    size_t start; //the unit builds the chunks of values[start .. end).
+    size_t end;
+    node *first;
+    node *last;
+} build_unit;
+
+typedef struct {
+    list *list;
+    const int *values;
+    build_unit *units;
+    int unitCount;
+    int nextUnit; //the next unit a thread takes.
+} build_job;
+
+static void *build_worker(void *arg) {
+    //Every unit is a chain of new chunks, nobody else sees the list yet so there is nothing to lock.
+    build_job *job = (build_job *) arg;
+    int index;
+    while ((index = __atomic_fetch_add(&job->nextUnit, 1, __ATOMIC_RELAXED)) < job->unitCount) {
+        build_unit *unit = &job->units[index];
+        node *prevChunk = NULL;
+        size_t i;
+        for (i = unit->start; i < unit->end; i += BUILD_FILL) {
+            node *newChunk = (node *) node_pool_alloc(job->list->pool);
+            int count = unit->end - i < BUILD_FILL ? (int) (unit->end - i) : BUILD_FILL;
+            int pos;
+            for (pos = 0; pos < count; pos++) {
+                set_value(newChunk, pos, job->values[i + pos]);
+            }
+            set_count(newChunk, count);
+            if (prevChunk) {
+                set_next(prevChunk, newChunk);
+            } else {
+                unit->first = newChunk;
+            }
+            prevChunk = newChunk;
+        }
+        set_next(prevChunk, NULL);
+        unit->last = prevChunk;
+    }
+    return NULL;
+}
+
+list *create_list_from_sorted(const int *values, size_t count) {
+    //The chunks are filled straight in their final order (BUILD_FILL values each), and a big array is cut
+    //into units of whole chunks that several threads build at once, then we link the units.
+    size_t i;
+    for (i = 1; i < count; i++) {
+        if (values[i] < values[i - 1]) { //Not sorted after all, the batch insert sorts it for us.
+            list *newList = create_list();
+            insert_values(newList, values, count);
+            return newList;
+        }
+    }
+    list *newList = create_list();
+    if (!newList || count == 0) {
+        return newList;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = count >= BUILD_PARALLEL_MIN && cpus > 1 ? (int) cpus : 1;
+    size_t unitCapacity = (size_t) threads * BUILD_UNITS_PER_THREAD;
+    size_t unitSize = (count + unitCapacity - 1) / unitCapacity;
+    unitSize = (unitSize + BUILD_FILL - 1) / BUILD_FILL * BUILD_FILL; //whole chunks.
+    build_unit *units = (build_unit *) malloc((count / unitSize + 1) * sizeof(build_unit));
+    if (!units) { //Error with memory allocation (malloc)
+        perror("error");
+        exit(1);
+    }
+    int unitCount = 0;
+    for (i = 0; i < count; i += unitSize) {
+        units[unitCount].start = i;
+        units[unitCount].end = count - i < unitSize ? count : i + unitSize;
+        unitCount++;
+    }
+
+    build_job job;
+    job.list = newList;
+    job.values = values;
+    job.units = units;
+    job.unitCount = unitCount;
+    job.nextUnit = 0;
+    pthread_t helpers[threads];
+    int created = 0;
+    while (created < threads - 1 && pthread_create(&helpers[created], NULL, build_worker, &job) == 0) {
+        created++;
+    }
+    build_worker(&job);
+    while (created > 0) {
+        pthread_join(helpers[--created], NULL);
+    }
+
+    node *prevChunk = &newList->head;
+    int u;
+    for (u = 0; u < unitCount; u++) {
+        set_next(prevChunk, units[u].first);
+        prevChunk = units[u].last;
+    }
+    free(units);
+    return newList;
+}
+
+void insert_value(list *list, int value) {
+    if (!list) {
+        return;
+    }
+
+    node *prevNode = &list->head;
+    list_lock_acquire_head(&(prevNode->lock));
+    node *currNode = prevNode->next;
+
+    //Finding the first chunk that has a value bigger than the new value (the new value goes after all the equal values).
+    unsigned int upTo = 0; //the values of curr that are smaller or equal.
+    while (currNode) {
+        list_lock_acquire(&(currNode->lock));
+        upTo = chunk_mask(currNode, value, 1);
+        if (upTo != count_mask(currNode)) {
+            break;
+        }
+        list_lock_release(&(prevNode->lock));
+        prevNode = currNode;
+        currNode = currNode->next;
+    }
+
+    int pos = currNode ? first_bit(~upTo & count_mask(currNode), currNode->count) : 0;
+    write_begin(list);
+    if (currNode && pos > 0) {
+        insert_at(list, currNode, pos, value); //Inside curr.
+    } else if (prevNode != &list->head) {
+        insert_at(list, prevNode, prevNode->count, value); //Every value of prev is smaller or equal, appending to it.
+    } else if (currNode) {
+        insert_at(list, currNode, 0, value); //The smallest value in the list.
+    } else {
+        node *newChunk = create_chunk(list, NULL); //Empty list.
+        set_value(newChunk, 0, value);
+        set_count(newChunk, 1);
+        set_next(prevNode, newChunk);
+    }
+    write_end(list);
+
+    if (currNode) {
+        list_lock_release(&(currNode->lock));
+    }
+    list_lock_release(&(prevNode->lock));
+}
+
+void remove_value(list *list, int value) {
+    if (!list) {
+        return;
+    }
+
+    node *prevNode = &list->head;
+    list_lock_acquire_head(&(prevNode->lock));
+    node *currNode = prevNode->next;
+
+    //The first chunk with a value bigger or equal holds the first occurrence (if the value is in the list),
+    //once a swap moved values we look until we find it.
+    unsigned int equal = 0;
+    while (currNode) {
+        list_lock_acquire(&(currNode->lock));
+        equal = chunk_equal(currNode, value);
+        if (equal || (!__atomic_load_n(&list->unsorted, __ATOMIC_RELAXED) &&
+                      currNode->values[currNode->count - 1] >= value)) {
+            break;
+        }
+        list_lock_release(&(prevNode->lock));
+        prevNode = currNode;
+        currNode = currNode->next;
+    }
+
+    if (currNode) {
+        int pos = first_bit(equal, currNode->count);
+        if (equal) { //Only 1 occurrence per call.
+            write_begin(list);
+            int i;
+            for (i = pos; i < currNode->count - 1; i++) {
+                set_value(currNode, i, currNode->values[i + 1]);
+            }
+            set_count(currNode, currNode->count - 1);
+
+            if (currNode->count == 0) {
+                //Empty chunk, unlinking it.
+                set_next(prevNode, currNode->next);
+                list_lock_release(&(currNode->lock));
+                node_pool_free(list->pool, currNode);
+                currNode = NULL;
+            } else if (currNode->count < CHUNK_MERGE_THRESHOLD && currNode->next) {
+                //Almost empty, merging the next chunk into this one if they fit together (locking in list order).
+                node *nextNode = currNode->next;
+                list_lock_acquire(&(nextNode->lock));
+                if (currNode->count + nextNode->count <= CHUNK_CAPACITY) {
+                    for (i = 0; i < nextNode->count; i++) {
+                        set_value(currNode, currNode->count + i, nextNode->values[i]);
+                    }
+                    set_count(currNode, currNode->count + nextNode->count);
+                    set_next(currNode, nextNode->next);
+                    list_lock_release(&(nextNode->lock));
+                    node_pool_free(list->pool, nextNode);
+                } else {
+                    list_lock_release(&(nextNode->lock));
+                }
+            }
+            write_end(list);
+        }
+    }
+
+    if (currNode) {
+        list_lock_release(&(currNode->lock));
+    }
+    list_lock_release(&(prevNode->lock));
+}
+
+void insert_values(list *list, const int *values, size_t count) {
+    //A chunk lock already covers up to CHUNK_CAPACITY values and the walk skips whole chunks,
+    //so a batch is just a loop.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        insert_value(list, values[i]);
+    }
+}
+
+void remove_values(list *list, const int *values, size_t count) {
+    //Same as insert_values - the first occurrence of every value is removed in order.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        remove_value(list, values[i]);
+    }
+}
+
+void print_list(list *list) {
+    if (!list) {
+        printf("\n");
+        return;
+    }
+
+    node *prevNode = &list->head;
+    list_lock_acquire_head(&(prevNode->lock));
+    node *currNode = prevNode->next;
+
+    while (currNode) {
+        list_lock_acquire(&(currNode->lock));
+        list_lock_release(&(prevNode->lock));
+        print_node(currNode);
+        prevNode = currNode;
+        currNode = currNode->next;
+    }
+    list_lock_release(&(prevNode->lock));
+
+    printf("\n"); // DO NOT DELETE
+}
+
+void count_list(list *list, int (*predicate)(int)) {
+    int count = 0; // DO NOT DELETE
+
+    if (!list) {
+        printf("%d items were counted\n", 0);
+        return;
+    }
+
+    node *prevNode = &list->head;
+    list_lock_acquire_head(&(prevNode->lock));
+    node *currNode = prevNode->next;
+
+    while (currNode) {
+        list_lock_acquire(&(currNode->lock));
+        list_lock_release(&(prevNode->lock));
+        //The predicate is a function pointer, so we can't vectorize it, but a whole chunk is one cache line
+        //and its values are contiguous, so we evaluate it over the chunk array in one go.
+        const int *values = currNode->values;
+        int chunkCount = currNode->count;
+        int i;
+        for (i = 0; i < chunkCount; i++) {
+            count += predicate(values[i]) != 0;
+        }
+        prevNode = currNode;
+        currNode = currNode->next;
+    }
+    list_lock_release(&(prevNode->lock));
+
+    printf("%d items were counted\n", count); // DO NOT DELETE
+}
+
+static void swap_locked(list *list, node *firstChunk, int firstPos, node *secondChunk, int secondPos) {
+    //Switching two values of chunks we hold the locks of (the values stay where they are, so the chunks
+    //may not be sorted any more), and releasing them.
+    int val1 = firstChunk->values[firstPos];
+    int val2 = secondChunk->values[secondPos];
+    __atomic_store_n(&list->unsorted, 1, __ATOMIC_RELAXED); //before the values move, see remove_value.
+    write_begin(list);
+    set_value(firstChunk, firstPos, val2);
+    set_value(secondChunk, secondPos, val1);
+    write_end(list);
+    list_lock_release(&(firstChunk->lock));
+    if (secondChunk != firstChunk) {
+        list_lock_release(&(secondChunk->lock));
+    }
+}
+
+/**
+ * Finds the first position of each value without locks (chunk copies validated with the seqlock, like the
+ * queries), then locks just the one or two chunks and checks that nobody wrote to the list in the meantime.
+ * @return 1 if the swap is done (or one of the values is not in the list), 0 if we need to try again.
+ */
+static int optimistic_swap(list *list, int val1, int val2) {
+    unsigned long version;
+    if (!read_begin(list, &version)) {
+        return 0;
+    }
+
+    node *firstChunk = NULL;
+    node *secondChunk = NULL;
+    int firstPos = 0;
+    int secondPos = 0;
+    node *metFirst = NULL; //the one of the two chunks we met first in the list.
+    node copy;
+    node *currNode = load_next(&list->head);
+    while (currNode && (!firstChunk || !secondChunk)) {
+        copy_chunk(currNode, &copy);
+        node *nextNode = load_next(currNode);
+        if (!read_validate(list, version)) { //Same as the queries, a reused chunk could lead us to a cycle.
+            return 0;
+        }
+        unsigned int equal;
+        if (!firstChunk && (equal = chunk_equal(&copy, val1))) {
+            firstChunk = currNode;
+            firstPos = first_bit(equal, 0);
+        }
+        if (!secondChunk && (equal = chunk_equal(&copy, val2))) {
+            secondChunk = currNode;
+            secondPos = first_bit(equal, 0);
+        }
+        if (!metFirst) {
+            metFirst = firstChunk ? firstChunk : secondChunk;
+        }
+        currNode = nextNode;
+    }
+    if (!firstChunk || !secondChunk) { //We can't switch if one of the values is missing.
+        return 1;
+    }
+
+    //Everybody locks in list order, so we block only on the chunk we met first. A chunk can be freed and
+    //reused before we lock it, so the second one is only a try (no deadlock either way).
+    node *metSecond = metFirst == firstChunk ? secondChunk : firstChunk;
+    list_lock_acquire(&(metFirst->lock));
+    if (metSecond != metFirst && !list_lock_try_acquire(&(metSecond->lock))) {
+        list_lock_release(&(metFirst->lock));
+        return 0;
+    }
+    if (!read_validate(list, version)) { //The chunks and the positions are still the ones we found.
+        if (metSecond != metFirst) {
+            list_lock_release(&(metSecond->lock));
+        }
+        list_lock_release(&(metFirst->lock));
+        return 0;
+    }
+    swap_locked(list, firstChunk, firstPos, secondChunk, secondPos);
+    return 1;
+}
+
+static void locked_swap(list *list, int val1, int val2) {
+    //Hand over hand like the other writers, a chunk where we found one of the values stays locked
+    //while we go on to the other one, and we stop as soon as we have both.
+    node *firstChunk = NULL;
+    node *secondChunk = NULL;
+    int firstPos = 0;
+    int secondPos = 0;
+    node *prevNode = &list->head;
+    list_lock_acquire_head(&(prevNode->lock));
+    node *currNode = prevNode->next;
+
+    while (currNode && (!firstChunk || !secondChunk)) {
+        list_lock_acquire(&(currNode->lock));
+        if (prevNode != firstChunk && prevNode != secondChunk) {
+            list_lock_release(&(prevNode->lock));
+        }
+        unsigned int equal;
+        if (!firstChunk && (equal = chunk_equal(currNode, val1))) {
+            firstChunk = currNode;
+            firstPos = first_bit(equal, 0);
+        }
+        if (!secondChunk && (equal = chunk_equal(currNode, val2))) {
+            secondChunk = currNode;
+            secondPos = first_bit(equal, 0);
+        }
+        prevNode = currNode;
+        currNode = currNode->next;
+    }
+    if (prevNode != firstChunk && prevNode != secondChunk) {
+        list_lock_release(&(prevNode->lock));
+    }
+
+    if (firstChunk && secondChunk) {
+        swap_locked(list, firstChunk, firstPos, secondChunk, secondPos);
+        return;
+    }
+    if (firstChunk) { //We can't switch if one of the values is missing.
+        list_lock_release(&(firstChunk->lock));
+    }
+    if (secondChunk) {
+        list_lock_release(&(secondChunk->lock));
+    }
+}
+
+void swap_values(list *list, int val1, int val2) {
+    //First we look for the two values without locks and lock only their chunks, and if the list keeps
+    //changing under us we go hand over hand (same as concurrent_list).
+    if (!list || val1 == val2) {
+        return;
+    }
+
+    int i;
+    for (i = 0; i < READ_TRIES; i++) {
+        if (optimistic_swap(list, val1, val2)) {
+            return;
+        }
+    }
+    locked_swap(list, val1, val2);
+}
+
+void swap_many(list *list, const int *pairs, size_t count) {
+    //Every swap searches without locks and locks only its own chunks, so a batch is just a loop.
+    size_t i;
+    for (i = 0; i < count; i++) {
+        swap_values(list, pairs[2 * i], pairs[2 * i + 1]);
+    }
+}
+
+/**
+ * Counts the values v with lo <= v <= hi without any lock, one chunk copy at a time.
+ * @param limit - stop after this many values (1 is enough for contains_value).
+ * @return 1 with the count in countOut, or 0 if a writer changed the list under us.
+ */
+static int optimistic_range_count(list *list, int lo, int hi, int limit, int *countOut) {
+    unsigned long version;
+    if (!read_begin(list, &version)) {
+        return 0;
+    }
+
+    int count = 0;
+    node copy;
+    node *currNode = load_next(&list->head);
+    while (currNode && count < limit) {
+        copy_chunk(currNode, &copy);
+        currNode = load_next(currNode);
+        //Checking every chunk, a reused chunk could lead us to a cycle.
+        if (!read_validate(list, version)) {
+            return 0;
+        }
+        if (chunk_range(&copy, lo, hi, &count)) {
+            break;
+        }
+    }
+    *countOut = count;
+    return 1;
+}
+
+static int locked_range_count(list *list, int lo, int hi, int limit) {
+    int count = 0;
+    node *prevNode = &list->head;
+    list_lock_acquire_head(&(prevNode->lock));
+    node *currNode = prevNode->next;
+
+    while (currNode && count < limit) {
+        list_lock_acquire(&(currNode->lock));
+        list_lock_release(&(prevNode->lock));
+        prevNode = currNode;
+        if (chunk_range(currNode, lo, hi, &count)) {
+            break;
+        }
+        currNode = currNode->next;
+    }
+    list_lock_release(&(prevNode->lock));
+    return count;
+}
+
+static int query_range(list *list, int lo, int hi, int limit) {
+    int count;
+    int i;
+    for (i = 0; i < READ_TRIES; i++) {
+        if (optimistic_range_count(list, lo, hi, limit, &count)) {
+            return count;
+        }
+    }
+    return locked_range_count(list, lo, hi, limit);
+}
+
+int contains_value(list *list, int value) {
+    if (!list) {
+        return 0;
+    }
+    return query_range(list, value, value, 1) > 0;
+}
+
+int range_count(list *list, int lo, int hi) {
+    if (!list || lo > hi) {
+        return 0;
+    }
+    return query_range(list, lo, hi, INT_MAX);
+}
+
+static void lock_list(list *list) {
+    //Takes the whole list for an iteration: the head keeps the hand over hand writers out, and walking to the
+    //end waits for the ones that are already inside. optimistic_swap takes no head, so the list is also in a
+    //write until unlock_list, a swap that locks a chunk after we passed it fails its version check.
+    list_lock_acquire_head(&(list->head.lock));
+    write_begin(list);
+    node *prevNode = list->head.next;
+    if (prevNode) {
+        list_lock_acquire(&(prevNode->lock));
+        while (prevNode->next) {
+            list_lock_acquire(&(prevNode->next->lock));
+            list_lock_release(&(prevNode->lock));
+            prevNode = prevNode->next;
+        }
+        list_lock_release(&(prevNode->lock));
+    }
+}
+
+static void unlock_list(list *list) {
+    write_end(list);
+    list_lock_release(&(list->head.lock));
+}
+
+//Iterations on this thread that list_iter_end failed in a row. The caller just begins again, so the count
+//can't live in the list_iter.
+static __thread int iterFailures = 0;
+
+void list_iter_begin(list *list, list_iter *iter) {
+    iter->list = list;
+    iter->nextNode = NULL;
+    iter->index = 0;
+    iter->valid = 0;
+    iter->locked = 0;
+    if (list && iterFailures >= ITER_TRIES) {
+        //The writers kept changing the list under our last tries, this time nobody writes until list_iter_end.
+        lock_list(list);
+        iter->locked = 1;
+        iter->valid = 1;
+        iter->nextNode = list->head.next;
+    } else if (list) {
+        iter->valid = read_begin(list, &iter->version);
+        if (iter->valid) {
+            iter->nextNode = load_next(&list->head);
+        }
+    }
+}
+
+int list_iter_next(list_iter *iter, int *value) {
+    while (iter->valid && iter->nextNode) {
+        node *chunk = iter->nextNode;
+        int count = __atomic_load_n(&chunk->count, __ATOMIC_RELAXED);
+        if (iter->index < count && iter->index < CHUNK_CAPACITY) {
+            *value = __atomic_load_n(&chunk->values[iter->index], __ATOMIC_RELAXED);
+            iter->index++;
+            return 1;
+        }
+        //Next chunk, checking the version first (the chunk may be reused and lead us to a cycle).
+        iter->nextNode = load_next(chunk);
+        iter->index = 0;
+        if (!iter->locked && !read_validate(iter->list, iter->version)) {
+            iter->valid = 0;
+        }
+    }
+    return 0;
+}
+
+int list_iter_end(list_iter *iter) {
+    if (!iter->list) {
+        return 1; //No list, an empty iteration is a snapshot.
+    }
+    if (iter->locked) {
+        unlock_list(iter->list);
+        iterFailures = 0;
+        return 1;
+    }
+    int snapshot = iter->valid && read_validate(iter->list, iter->version);
+    iterFailures = snapshot ? 0 : iterFailures + 1;
+    return snapshot;
+}
@@ -0,0 +1,137 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "epoch.h"
+
+//How many retired entries a thread collects before it tries to advance the global epoch.
+#define EPOCH_RETIRE_THRESHOLD 64
+
+typedef struct epoch_record epoch_record;
+
+struct epoch_record {
+    unsigned long localEpoch; //the global epoch this thread saw when it entered.
+    int active; //1 while the thread is between epoch_enter and epoch_exit.
+    int depth; //epoch_enter calls without their epoch_exit yet, only the owner thread uses it.
+    int inUse; //1 while a live thread owns this record.
+    epoch_entry *limbo; //retired entries that are waiting to be freed (newest first).
+    int limboCount;
+    epoch_record *next; //next record in the registry, records are never removed.
+};
+
+static unsigned long globalEpoch = 0;
+static epoch_record *records = NULL; //registry of every record ever created.
+static __thread epoch_record *myRecord = NULL;
+static pthread_key_t recordKey;
+static pthread_once_t recordKeyOnce = PTHREAD_ONCE_INIT;
+
+static void release_record(void *arg) {
+    //Thread exit - the record goes back to the registry, its limbo list is inherited by the next owner.
+    epoch_record *record = arg;
+    record->depth = 0;
+    __atomic_store_n(&record->active, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&record->inUse, 0, __ATOMIC_RELEASE);
+}
+
+static void create_record_key(void) {
+    pthread_key_create(&recordKey, release_record);
+}
+
+static epoch_record *get_record(void) {
+    if (myRecord) {
+        return myRecord;
+    }
+    pthread_once(&recordKeyOnce, create_record_key);
+
+    //First, we try to reuse a record of a thread that already exited.
+    epoch_record *record;
+    for (record = __atomic_load_n(&records, __ATOMIC_ACQUIRE); record; record = record->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&record->inUse, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (!record) { //No free record, creating a new one and pushing it to the registry.
+        record = (epoch_record *) calloc(1, sizeof(epoch_record));
+        if (!record) {
+            perror("error");
+            exit(1);
+        }
+        record->inUse = 1;
+        record->next = __atomic_load_n(&records, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&records, &record->next, record, 0, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED)) {
+        }
+    }
+
+    pthread_setspecific(recordKey, record);
+    myRecord = record;
+    return record;
+}
+
+static void reclaim(epoch_record *record) {
+    //An entry retired in epoch e can't be reached once the global epoch got to e + 2.
+    //The limbo list is ordered newest first, so once we find a safe entry all the entries after it are safe too.
+    unsigned long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    epoch_entry **link = &record->limbo;
+
+    while (*link && (*link)->epoch + 2 > epoch) {
+        link = &(*link)->next;
+    }
+
+    epoch_entry *entry = *link;
+    *link = NULL;
+    while (entry) {
+        epoch_entry *next = entry->next;
+        entry->destroy(entry);
+        record->limboCount--;
+        entry = next;
+    }
+}
+
+static void try_advance(void) {
+    //The global epoch can only move forward once every active thread already saw the current one.
+    unsigned long epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    epoch_record *record;
+
+    for (record = __atomic_load_n(&records, __ATOMIC_ACQUIRE); record; record = record->next) {
+        if (__atomic_load_n(&record->active, __ATOMIC_SEQ_CST) &&
+            __atomic_load_n(&record->localEpoch, __ATOMIC_SEQ_CST) != epoch) {
+            return; //some thread is still behind, we will try again on the next retire.
+        }
+    }
+    __atomic_compare_exchange_n(&globalEpoch, &epoch, epoch + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+void epoch_enter(void) {
+    epoch_record *record = get_record();
+    if (record->depth++ > 0) {
+        return; //Already inside, the outer epoch_enter keeps us active (and in its epoch).
+    }
+    __atomic_store_n(&record->localEpoch, __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST), __ATOMIC_SEQ_CST);
+    __atomic_store_n(&record->active, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void epoch_exit(void) {
+    if (--myRecord->depth > 0) {
+        return;
+    }
+    __atomic_store_n(&myRecord->active, 0, __ATOMIC_RELEASE);
+}
+
+void epoch_retire(epoch_entry *entry, void (*destroy)(epoch_entry *entry)) {
+    //Must be called inside epoch_enter/epoch_exit, after the entry was unlinked from the shared structure.
+    epoch_record *record = get_record();
+
+    entry->destroy = destroy;
+    entry->epoch = __atomic_load_n(&globalEpoch, __ATOMIC_SEQ_CST);
+    entry->next = record->limbo;
+    record->limbo = entry;
+    record->limboCount++;
+
+    if (record->limboCount >= EPOCH_RETIRE_THRESHOLD) {
+        try_advance();
+        reclaim(record);
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef _EPOCH_H_
+#define _EPOCH_H_
+
+//Epoch based memory reclamation, shared by the list backends that let threads read nodes without locks.
+//A thread wraps every access to shared nodes with epoch_enter/epoch_exit, and once a node is unlinked
+//it is handed to epoch_retire instead of free, it is destroyed only when no thread can still reach it.
+//The calls nest (a list call inside a list iteration), the thread leaves the epoch at the outermost epoch_exit.
+
+typedef struct epoch_entry epoch_entry;
+
+struct epoch_entry {
+    epoch_entry *next; //next retired entry of the same thread (newest first).
+    unsigned long epoch; //global epoch at the moment the entry was retired.
+    void (*destroy)(epoch_entry *entry); //called once the entry is safe to free.
+};
+
+void epoch_enter(void);
+void epoch_exit(void);
+void epoch_retire(epoch_entry *entry, void (*destroy)(epoch_entry *entry));
+
+#endif
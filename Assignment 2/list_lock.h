@@ -0,0 +1,213 @@
+#ifndef _LIST_LOCK_H_
+#define _LIST_LOCK_H_
+
+#include <pthread.h>
+#include <sched.h>
+#include "list_stats.h"
+
+//The lock embedded in every list node (and in the list head), selected at build time with LIST_LOCK:
+//LIST_LOCK_MUTEX  - pthread_mutex_t (40 bytes on glibc, a node takes 56 bytes).
+//LIST_LOCK_SPIN   - 1 byte test-and-test-and-set spinlock with exponential backoff (a node takes 16 bytes).
+//LIST_LOCK_TICKET - 4 byte FIFO ticket lock (a node takes 16 bytes).
+//The spinning locks yield the CPU after a while, so a preempted lock holder can still make progress.
+//The lists lock with list_lock_acquire/list_lock_acquire_head, list_lock_try_acquire (a node, never waits)
+//and list_lock_release (bottom of this file), with LIST_STATS they also count acquisitions, wait and hold times
+//(see list_stats.h).
+
+#define LIST_LOCK_MUTEX 0
+#define LIST_LOCK_SPIN 1
+#define LIST_LOCK_TICKET 2
+
+#ifndef LIST_LOCK
+#define LIST_LOCK LIST_LOCK_MUTEX
+#endif
+
+#define LIST_LOCK_MAX_BACKOFF 1024 //max pause loops between two tries.
+#define LIST_LOCK_SPINS_BEFORE_YIELD 64 //tries before we start to sched_yield.
+
+static inline void list_lock_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    __atomic_signal_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+#if LIST_LOCK == LIST_LOCK_MUTEX
+
+typedef pthread_mutex_t list_lock;
+#define LIST_LOCK_NAME "mutex"
+#define LIST_LOCK_NEEDS_DESTROY 1 //0 if list_lock_destroy does nothing (so a pool can skip it for every node).
+
+static inline int list_lock_init(list_lock *lock) {
+    return pthread_mutex_init(lock, NULL);
+}
+
+static inline void list_lock_destroy(list_lock *lock) {
+    pthread_mutex_destroy(lock);
+}
+
+static inline void list_lock_acquire_raw(list_lock *lock) {
+    pthread_mutex_lock(lock);
+}
+
+static inline int list_lock_try_acquire_raw(list_lock *lock) {
+    return pthread_mutex_trylock(lock) == 0;
+}
+
+static inline void list_lock_release_raw(list_lock *lock) {
+    pthread_mutex_unlock(lock);
+}
+
+#elif LIST_LOCK == LIST_LOCK_SPIN
+
+typedef unsigned char list_lock;
+#define LIST_LOCK_NAME "spin"
+#define LIST_LOCK_NEEDS_DESTROY 0
+
+static inline int list_lock_init(list_lock *lock) {
+    *lock = 0;
+    return 0;
+}
+
+static inline void list_lock_destroy(list_lock *lock) {
+    (void) lock;
+}
+
+static inline void list_lock_acquire_raw(list_lock *lock) {
+    unsigned int backoff = 1;
+    unsigned int tries = 0;
+    while (1) {
+        //Test first (a plain read keeps the cache line shared), and only then test-and-set.
+        if (!__atomic_load_n(lock, __ATOMIC_RELAXED) && !__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE)) {
+            return;
+        }
+        if (++tries >= LIST_LOCK_SPINS_BEFORE_YIELD) {
+            sched_yield();
+            continue;
+        }
+        unsigned int i;
+        for (i = 0; i < backoff; i++) {
+            list_lock_pause();
+        }
+        if (backoff < LIST_LOCK_MAX_BACKOFF) {
+            backoff <<= 1;
+        }
+    }
+}
+
+static inline int list_lock_try_acquire_raw(list_lock *lock) {
+    return !__atomic_load_n(lock, __ATOMIC_RELAXED) && !__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE);
+}
+
+static inline void list_lock_release_raw(list_lock *lock) {
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+#elif LIST_LOCK == LIST_LOCK_TICKET
+
+typedef struct {
+    unsigned short next; //next ticket to hand out.
+    unsigned short owner; //ticket that holds the lock now.
+} list_lock;
+#define LIST_LOCK_NAME "ticket"
+#define LIST_LOCK_NEEDS_DESTROY 0
+
+static inline int list_lock_init(list_lock *lock) {
+    lock->next = 0;
+    lock->owner = 0;
+    return 0;
+}
+
+static inline void list_lock_destroy(list_lock *lock) {
+    (void) lock;
+}
+
+static inline void list_lock_acquire_raw(list_lock *lock) {
+    unsigned short ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+    unsigned int tries = 0;
+    while (1) {
+        unsigned short owner = __atomic_load_n(&lock->owner, __ATOMIC_ACQUIRE);
+        if (owner == ticket) {
+            return;
+        }
+        if (++tries >= LIST_LOCK_SPINS_BEFORE_YIELD) {
+            sched_yield();
+            continue;
+        }
+        //Backoff proportional to the number of threads before us in the queue.
+        unsigned int i;
+        for (i = 0; i < (unsigned short) (ticket - owner) * 32u; i++) {
+            list_lock_pause();
+        }
+    }
+}
+
+static inline int list_lock_try_acquire_raw(list_lock *lock) {
+    //Only takes a ticket if it is served right away.
+    unsigned short owner = __atomic_load_n(&lock->owner, __ATOMIC_RELAXED);
+    unsigned short expected = owner;
+    return __atomic_compare_exchange_n(&lock->next, &expected, (unsigned short) (owner + 1), 0, __ATOMIC_ACQUIRE,
+                                       __ATOMIC_RELAXED);
+}
+
+static inline void list_lock_release_raw(list_lock *lock) {
+    __atomic_store_n(&lock->owner, (unsigned short) (lock->owner + 1), __ATOMIC_RELEASE);
+}
+
+#else
+#error "LIST_LOCK must be LIST_LOCK_MUTEX, LIST_LOCK_SPIN or LIST_LOCK_TICKET"
+#endif
+
+#if LIST_STATS
+
+static inline void list_lock_acquire_kind(list_lock *lock, int kind) {
+    if (list_lock_try_acquire_raw(lock)) {
+        list_stats_lock_acquired(lock, kind, 0, 0);
+        return;
+    }
+    unsigned long long start = list_stats_now();
+    list_lock_acquire_raw(lock);
+    list_stats_lock_acquired(lock, kind, list_stats_now() - start, 1);
+}
+
+static inline int list_lock_try_acquire(list_lock *lock) {
+    //Counted (and its hold time kept) only if we got it, a failed try never waited.
+    if (!list_lock_try_acquire_raw(lock)) {
+        return 0;
+    }
+    list_stats_lock_acquired(lock, LIST_LOCK_KIND_NODE, 0, 0);
+    return 1;
+}
+
+static inline void list_lock_release(list_lock *lock) {
+    list_stats_lock_released(lock);
+    list_lock_release_raw(lock);
+}
+
+#else
+
+static inline void list_lock_acquire_kind(list_lock *lock, int kind) {
+    (void) kind;
+    list_lock_acquire_raw(lock);
+}
+
+static inline int list_lock_try_acquire(list_lock *lock) {
+    return list_lock_try_acquire_raw(lock);
+}
+
+static inline void list_lock_release(list_lock *lock) {
+    list_lock_release_raw(lock);
+}
+
+#endif
+
+static inline void list_lock_acquire(list_lock *lock) {
+    list_lock_acquire_kind(lock, LIST_LOCK_KIND_NODE);
+}
+
+static inline void list_lock_acquire_head(list_lock *lock) {
+    list_lock_acquire_kind(lock, LIST_LOCK_KIND_HEAD);
+}
+
+#endif
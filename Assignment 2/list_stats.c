@@ -0,0 +1,270 @@
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "list_stats.h"
+
+static const char *kindNames[LIST_LOCK_KINDS] = {"head", "node"};
+static const char *opNames[LIST_OPS] = {"insert_value", "remove_value", "insert_values", "remove_values",
+                                        "count_list", "print_list", "swap_values", "query"};
+
+#if LIST_STATS
+
+#define STATS_MAX_HELD 64 //locks one thread holds at once that we time (rebalance_shards holds every shard head).
+
+typedef struct stats_record stats_record;
+
+struct stats_record {
+    lock_stats locks[LIST_LOCK_KINDS];
+    op_stats ops[LIST_OPS];
+    int inUse; //1 while a live thread owns this record, a new thread takes over the record of an exited one.
+    stats_record *next; //next record in the registry, records are never removed (so their counts stay).
+};
+
+typedef struct {
+    void *lock;
+    int kind;
+    unsigned long long start;
+} held_lock;
+
+static stats_record *records = NULL;
+static __thread stats_record *myRecord = NULL;
+static __thread held_lock held[STATS_MAX_HELD];
+static __thread int heldCount = 0;
+__thread unsigned long long listStatsSteps = 0;
+static pthread_key_t recordKey;
+static pthread_once_t recordKeyOnce = PTHREAD_ONCE_INIT;
+
+static void release_record(void *arg) {
+    stats_record *record = arg;
+    __atomic_store_n(&record->inUse, 0, __ATOMIC_RELEASE);
+}
+
+static void create_record_key(void) {
+    pthread_key_create(&recordKey, release_record);
+}
+
+static stats_record *get_record(void) {
+    if (myRecord) {
+        return myRecord;
+    }
+    pthread_once(&recordKeyOnce, create_record_key);
+
+    stats_record *record;
+    for (record = __atomic_load_n(&records, __ATOMIC_ACQUIRE); record; record = record->next) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&record->inUse, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+
+    if (!record) {
+        record = (stats_record *) calloc(1, sizeof(stats_record));
+        if (!record) {
+            perror("error");
+            exit(1);
+        }
+        record->inUse = 1;
+        record->next = __atomic_load_n(&records, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&records, &record->next, record, 0, __ATOMIC_RELEASE,
+                                            __ATOMIC_RELAXED)) {
+        }
+    }
+    pthread_setspecific(recordKey, record);
+    myRecord = record;
+    return record;
+}
+
+//Only the owner thread writes a record, the atomics are only there so list_stats can read it at the same time.
+static inline void add_count(unsigned long *counter, unsigned long value) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+}
+
+static inline void add_time(unsigned long long *total, unsigned long long *max, unsigned long long value) {
+    __atomic_store_n(total, __atomic_load_n(total, __ATOMIC_RELAXED) + value, __ATOMIC_RELAXED);
+    if (value > __atomic_load_n(max, __ATOMIC_RELAXED)) {
+        __atomic_store_n(max, value, __ATOMIC_RELAXED);
+    }
+}
+
+unsigned long long list_stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long) ts.tv_sec * 1000000000ULL + (unsigned long long) ts.tv_nsec;
+}
+
+void list_stats_lock_acquired(void *lock, int kind, unsigned long long waitNs, int contended) {
+    lock_stats *stats = &get_record()->locks[kind];
+    add_count(&stats->acquisitions, 1);
+    if (contended) {
+        add_count(&stats->contended, 1);
+        add_time(&stats->waitNs, &stats->maxWaitNs, waitNs);
+    }
+    if (heldCount < STATS_MAX_HELD) {
+        held[heldCount].lock = lock;
+        held[heldCount].kind = kind;
+        held[heldCount].start = list_stats_now();
+        heldCount++;
+    }
+}
+
+void list_stats_lock_released(void *lock) {
+    //Hand over hand releases the oldest lock first, so we look from the bottom of the held locks.
+    int i;
+    for (i = 0; i < heldCount; i++) {
+        if (held[i].lock == lock) {
+            break;
+        }
+    }
+    if (i == heldCount) {
+        return; //One of the locks we had no room for.
+    }
+    lock_stats *stats = &get_record()->locks[held[i].kind];
+    add_time(&stats->holdNs, &stats->maxHoldNs, list_stats_now() - held[i].start);
+    heldCount--;
+    for (; i < heldCount; i++) {
+        held[i] = held[i + 1];
+    }
+}
+
+void list_stats_op(int op) {
+    op_stats *stats = &get_record()->ops[op];
+    add_count(&stats->calls, 1);
+    add_time(&stats->steps, &stats->maxSteps, listStatsSteps);
+    listStatsSteps = 0;
+}
+
+static void max_into(unsigned long long *into, unsigned long long *from) {
+    unsigned long long value = __atomic_load_n(from, __ATOMIC_RELAXED);
+    if (value > *into) {
+        *into = value;
+    }
+}
+
+void list_stats(list_stats_data *stats) {
+    memset(stats, 0, sizeof(list_stats_data));
+    stats->enabled = 1;
+    stats_record *record;
+    for (record = __atomic_load_n(&records, __ATOMIC_ACQUIRE); record; record = record->next) {
+        int i;
+        for (i = 0; i < LIST_LOCK_KINDS; i++) {
+            lock_stats *from = &record->locks[i];
+            lock_stats *into = &stats->locks[i];
+            into->acquisitions += __atomic_load_n(&from->acquisitions, __ATOMIC_RELAXED);
+            into->contended += __atomic_load_n(&from->contended, __ATOMIC_RELAXED);
+            into->waitNs += __atomic_load_n(&from->waitNs, __ATOMIC_RELAXED);
+            into->holdNs += __atomic_load_n(&from->holdNs, __ATOMIC_RELAXED);
+            max_into(&into->maxWaitNs, &from->maxWaitNs);
+            max_into(&into->maxHoldNs, &from->maxHoldNs);
+        }
+        for (i = 0; i < LIST_OPS; i++) {
+            op_stats *from = &record->ops[i];
+            op_stats *into = &stats->ops[i];
+            into->calls += __atomic_load_n(&from->calls, __ATOMIC_RELAXED);
+            into->steps += __atomic_load_n(&from->steps, __ATOMIC_RELAXED);
+            max_into(&into->maxSteps, &from->maxSteps);
+        }
+    }
+}
+
+void list_stats_reset(void) {
+    //Not atomic with the threads that count right now, a count that races with the reset may be lost.
+    stats_record *record;
+    for (record = __atomic_load_n(&records, __ATOMIC_ACQUIRE); record; record = record->next) {
+        int i;
+        for (i = 0; i < LIST_LOCK_KINDS; i++) {
+            lock_stats *stats = &record->locks[i];
+            __atomic_store_n(&stats->acquisitions, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&stats->contended, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&stats->waitNs, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&stats->holdNs, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&stats->maxWaitNs, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&stats->maxHoldNs, 0, __ATOMIC_RELAXED);
+        }
+        for (i = 0; i < LIST_OPS; i++) {
+            op_stats *stats = &record->ops[i];
+            __atomic_store_n(&stats->calls, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&stats->steps, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&stats->maxSteps, 0, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static void *dump_stats(void *arg) {
+    double seconds = *(double *) arg;
+    free(arg);
+    struct timespec sleepTime;
+    sleepTime.tv_sec = (time_t) seconds;
+    sleepTime.tv_nsec = (long) ((seconds - (double) sleepTime.tv_sec) * 1e9);
+    while (1) {
+        nanosleep(&sleepTime, NULL);
+        list_stats_print(stderr);
+    }
+    return NULL;
+}
+
+__attribute__((constructor)) static void start_dump(void) {
+    //LIST_STATS_DUMP=<seconds> - a detached thread prints the statistics until the process exits.
+    const char *value = getenv("LIST_STATS_DUMP");
+    if (!value || atof(value) <= 0) {
+        return;
+    }
+    double *seconds = (double *) malloc(sizeof(double));
+    if (!seconds) {
+        perror("error");
+        exit(1);
+    }
+    *seconds = atof(value);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, dump_stats, seconds) != 0) {
+        free(seconds);
+        return;
+    }
+    pthread_detach(thread);
+}
+
+#else
+
+void list_stats(list_stats_data *stats) {
+    memset(stats, 0, sizeof(list_stats_data));
+}
+
+void list_stats_reset(void) {
+}
+
+#endif
+
+void list_stats_print(FILE *out) {
+    list_stats_data stats;
+    list_stats(&stats);
+    if (!stats.enabled) {
+        fprintf(out, "list stats: not collected (build with STATS=1)\n");
+        return;
+    }
+
+    fprintf(out, "list stats:\n");
+    fprintf(out, "  %-14s %14s %12s %14s %14s %14s %14s\n", "lock", "acquisitions", "contended", "avg wait(ns)",
+            "max wait(ns)", "avg hold(ns)", "max hold(ns)");
+    int i;
+    for (i = 0; i < LIST_LOCK_KINDS; i++) {
+        lock_stats *lock = &stats.locks[i];
+        if (lock->acquisitions == 0) {
+            continue;
+        }
+        fprintf(out, "  %-14s %14lu %12lu %14.0f %14llu %14.0f %14llu\n", kindNames[i], lock->acquisitions,
+                lock->contended, lock->contended ? (double) lock->waitNs / lock->contended : 0.0, lock->maxWaitNs,
+                (double) lock->holdNs / lock->acquisitions, lock->maxHoldNs);
+    }
+    fprintf(out, "  %-14s %14s %12s %14s\n", "op", "calls", "avg steps", "max steps");
+    for (i = 0; i < LIST_OPS; i++) {
+        op_stats *op = &stats.ops[i];
+        if (op->calls == 0) {
+            continue;
+        }
+        fprintf(out, "  %-14s %14lu %12.1f %14llu\n", opNames[i], op->calls, (double) op->steps / op->calls,
+                op->maxSteps);
+    }
+    fflush(out);
+}
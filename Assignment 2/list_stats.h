@@ -0,0 +1,75 @@
+#ifndef _LIST_STATS_H_
+#define _LIST_STATS_H_
+
+#include <stdio.h>
+
+//Lock and traversal statistics of the list backends, only collected when built with LIST_STATS=1 ("make STATS=1"),
+//otherwise every hook below is empty and list_stats returns zeros (with enabled = 0).
+//The counters are per thread (no shared cache line on the fast path), list_stats sums them over all the threads.
+//Setting LIST_STATS_DUMP=<seconds> in the environment prints the statistics to stderr every that many seconds.
+
+#ifndef LIST_STATS
+#define LIST_STATS 0
+#endif
+
+#define LIST_LOCK_KIND_HEAD 0 //the list head (or a shard head), every locked operation starts there.
+#define LIST_LOCK_KIND_NODE 1
+#define LIST_LOCK_KINDS 2
+
+#define LIST_OP_INSERT 0
+#define LIST_OP_REMOVE 1
+#define LIST_OP_INSERT_BATCH 2
+#define LIST_OP_REMOVE_BATCH 3
+#define LIST_OP_COUNT 4
+#define LIST_OP_PRINT 5
+#define LIST_OP_SWAP 6
+#define LIST_OP_QUERY 7 //contains_value, range_count and the iterators when they fall back to the locks.
+#define LIST_OPS 8
+
+typedef struct {
+    unsigned long acquisitions;
+    unsigned long contended; //acquisitions that had to wait (the lock was taken when we tried).
+    unsigned long long waitNs; //total time we waited for the lock.
+    unsigned long long holdNs; //total time the lock was held.
+    unsigned long long maxWaitNs;
+    unsigned long long maxHoldNs;
+} lock_stats;
+
+typedef struct {
+    unsigned long calls;
+    unsigned long long steps; //nodes we walked over, in total.
+    unsigned long long maxSteps;
+} op_stats;
+
+typedef struct {
+    int enabled; //0 if the library was built without LIST_STATS.
+    lock_stats locks[LIST_LOCK_KINDS];
+    op_stats ops[LIST_OPS];
+} list_stats_data;
+
+void list_stats(list_stats_data *stats);
+void list_stats_reset(void);
+void list_stats_print(FILE *out);
+
+#if LIST_STATS
+
+unsigned long long list_stats_now(void);
+void list_stats_lock_acquired(void *lock, int kind, unsigned long long waitNs, int contended);
+void list_stats_lock_released(void *lock);
+void list_stats_op(int op);
+
+extern __thread unsigned long long listStatsSteps;
+
+//For the traversal length, an operation counts every node it walks over with LIST_STATS_STEP,
+//and reports them once at its end with LIST_STATS_OP (that also starts the count of the next operation).
+#define LIST_STATS_STEP() (listStatsSteps++)
+#define LIST_STATS_OP(op) list_stats_op(op)
+
+#else
+
+#define LIST_STATS_STEP() ((void) 0)
+#define LIST_STATS_OP(op) ((void) 0)
+
+#endif
+
+#endif
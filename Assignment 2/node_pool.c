@@ -0,0 +1,204 @@
+#define _POSIX_C_SOURCE 200112L
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "node_pool.h"
+
+#define POOL_MAX_THREADS 64 //threads after that share one cache (with the pool mutex).
+#define POOL_SHARED_SLOT POOL_MAX_THREADS
+#define POOL_SLAB_SIZE (64 * 1024) //slabs are aligned to their size, so an object finds its slab by masking.
+#define CACHE_LINE 64
+
+typedef struct slab slab;
+
+struct slab {
+    slab *next; //next slab of the same pool.
+    int owner; //the thread slot that created this slab, its objects are freed back to that cache.
+};
+
+typedef struct {
+    void *local; //free objects, only the owner thread uses this list.
+    void *remote; //free objects pushed by other threads, the owner takes all of them at once.
+    char padding[CACHE_LINE - 2 * sizeof(void *)]; //every cache in its own cache line.
+} pool_cache;
+
+struct node_pool {
+    pool_cache caches[POOL_MAX_THREADS + 1]; //one per thread slot, the last one is the shared cache.
+    size_t objectSize;
+    size_t linkOffset;
+    size_t firstOffset; //offset of the first object in a slab (after the slab header).
+    size_t objectsPerSlab;
+    void (*init)(void *);
+    void (*destroy)(void *);
+    slab *slabs; //every slab of the pool, for the bulk release.
+    pthread_mutex_t mutex; //the mutex lock for the shared cache.
+};
+
+static int slotUsed[POOL_MAX_THREADS]; //thread slots are shared by all the pools.
+static __thread int poolSlot = -1;
+static pthread_key_t slotKey;
+static pthread_once_t slotKeyOnce = PTHREAD_ONCE_INIT;
+
+static void release_slot(void *arg) {
+    //Thread exit - the next thread that takes this slot inherits its caches.
+    int slot = (int) (intptr_t) arg - 1;
+    __atomic_store_n(&slotUsed[slot], 0, __ATOMIC_RELEASE);
+}
+
+static void create_slot_key(void) {
+    pthread_key_create(&slotKey, release_slot);
+}
+
+static int get_slot(void) {
+    if (poolSlot >= 0) {
+        return poolSlot;
+    }
+    pthread_once(&slotKeyOnce, create_slot_key);
+
+    int slot;
+    for (slot = 0; slot < POOL_MAX_THREADS; slot++) {
+        int expected = 0;
+        if (__atomic_compare_exchange_n(&slotUsed[slot], &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            pthread_setspecific(slotKey, (void *) (intptr_t) (slot + 1));
+            poolSlot = slot;
+            return slot;
+        }
+    }
+    poolSlot = POOL_SHARED_SLOT; //No free slot.
+    return poolSlot;
+}
+
+static inline void **object_link(node_pool *pool, void *object) {
+    return (void **) ((char *) object + pool->linkOffset);
+}
+
+static inline slab *object_slab(void *object) {
+    return (slab *) ((uintptr_t) object & ~((uintptr_t) POOL_SLAB_SIZE - 1));
+}
+
+static void create_slab(node_pool *pool, pool_cache *cache, int slot) {
+    void *memory;
+    if (posix_memalign(&memory, POOL_SLAB_SIZE, POOL_SLAB_SIZE) != 0) {
+        //Error with memory allocation.
+        perror("error");
+        exit(1);
+    }
+
+    slab *newSlab = (slab *) memory;
+    newSlab->owner = slot;
+    newSlab->next = __atomic_load_n(&pool->slabs, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&pool->slabs, &newSlab->next, newSlab, 0, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+    }
+
+    //Pushing from the last object, so the objects come out in address order.
+    size_t i;
+    for (i = pool->objectsPerSlab; i > 0; i--) {
+        char *object = (char *) memory + pool->firstOffset + (i - 1) * pool->objectSize;
+        if (pool->init) {
+            pool->init(object);
+        }
+        *object_link(pool, object) = cache->local;
+        cache->local = object;
+    }
+}
+
+node_pool *node_pool_create(size_t objectSize, size_t linkOffset, void (*init)(void *), void (*destroy)(void *)) {
+    void *memory;
+    if (posix_memalign(&memory, CACHE_LINE, sizeof(node_pool)) != 0) {
+        //Error with memory allocation.
+        perror("error");
+        exit(1);
+    }
+
+    node_pool *pool = (node_pool *) memory;
+    int slot;
+    for (slot = 0; slot <= POOL_MAX_THREADS; slot++) {
+        pool->caches[slot].local = NULL;
+        pool->caches[slot].remote = NULL;
+    }
+    if (objectSize < sizeof(void *)) {
+        objectSize = sizeof(void *);
+    }
+    pool->objectSize = objectSize;
+    pool->linkOffset = linkOffset;
+    pool->firstOffset = (sizeof(slab) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    pool->objectsPerSlab = (POOL_SLAB_SIZE - pool->firstOffset) / objectSize;
+    pool->init = init;
+    pool->destroy = destroy;
+    pool->slabs = NULL;
+
+    if (pthread_mutex_init(&(pool->mutex), NULL) != 0) {
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void node_pool_delete(node_pool *pool) {
+    //Every object lives in one of the slabs, so we release the slabs without looking at the free lists.
+    if (!pool) {
+        return;
+    }
+
+    slab *currSlab = pool->slabs;
+    while (currSlab) {
+        slab *deleteSlab = currSlab;
+        currSlab = currSlab->next;
+        if (pool->destroy) {
+            size_t i;
+            for (i = 0; i < pool->objectsPerSlab; i++) {
+                pool->destroy((char *) deleteSlab + pool->firstOffset + i * pool->objectSize);
+            }
+        }
+        free(deleteSlab);
+    }
+    pthread_mutex_destroy(&(pool->mutex));
+    free(pool);
+}
+
+void *node_pool_alloc(node_pool *pool) {
+    int slot = get_slot();
+    pool_cache *cache = &pool->caches[slot];
+
+    if (slot == POOL_SHARED_SLOT) {
+        pthread_mutex_lock(&(pool->mutex));
+    }
+
+    if (!cache->local) {
+        //Taking everything other threads freed back to us, and only if there is nothing - a new slab.
+        cache->local = __atomic_exchange_n(&cache->remote, NULL, __ATOMIC_ACQUIRE);
+        if (!cache->local) {
+            create_slab(pool, cache, slot);
+        }
+    }
+    void *object = cache->local;
+    cache->local = *object_link(pool, object);
+
+    if (slot == POOL_SHARED_SLOT) {
+        pthread_mutex_unlock(&(pool->mutex));
+    }
+    return object;
+}
+
+void node_pool_free(node_pool *pool, void *object) {
+    int slot = get_slot();
+    int owner = object_slab(object)->owner;
+    pool_cache *cache = &pool->caches[owner];
+
+    //The link is written with an atomic store, a lock-free reader of the list may still read this object
+    //(objects stay in their slab until node_pool_delete, so such a read is always safe, just stale).
+    if (owner == slot && slot != POOL_SHARED_SLOT) {
+        //Our own object, no synchronization needed.
+        __atomic_store_n(object_link(pool, object), cache->local, __ATOMIC_RELAXED);
+        cache->local = object;
+        return;
+    }
+
+    //Remote free - pushing it to the owner cache, the owner takes the whole list at once, so there is no ABA.
+    void *head = __atomic_load_n(&cache->remote, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(object_link(pool, object), head, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&cache->remote, &head, object, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,27 @@
+#ifndef _NODE_POOL_H_
+#define _NODE_POOL_H_
+
+#include <stddef.h>
+
+//Slab pool for fixed size objects (list nodes).
+//Objects are carved from big slabs and initialized once (init) when their slab is created, so they
+//come back from node_pool_alloc already initialized (e.g. with a ready mutex).
+//Every thread has its own free cache, objects freed by another thread go back to the cache of the thread
+//that created their slab (remote free), and node_pool_delete releases all the slabs at once.
+//Objects never go back to malloc before node_pool_delete, so a reader that still holds a pointer to a freed
+//object reads stale (but valid) memory, that is what lets the list readers skip the node locks.
+
+typedef struct node_pool node_pool;
+
+/**
+ * @param objectSize - size of every object.
+ * @param linkOffset - offset of a pointer field in the object that the pool may use while the object is free.
+ * @param init - called once for every object when its slab is created (can be NULL).
+ * @param destroy - called once for every object when the pool is deleted (can be NULL).
+ */
+node_pool *node_pool_create(size_t objectSize, size_t linkOffset, void (*init)(void *), void (*destroy)(void *));
+void node_pool_delete(node_pool *pool);
+void *node_pool_alloc(node_pool *pool);
+void node_pool_free(node_pool *pool, void *object);
+
+#endif
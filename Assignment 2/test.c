@@ -0,0 +1,636 @@
+#define _GNU_SOURCE
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "concurrent_list.h"
+#include "list_lock.h"
+#include "list_stats.h"
+
+//Test and benchmark driver of the list backend that was linked in (see "make LIST=... LOCK=... SHARDS=...").
+//Replay (default): reads a command script from stdin (tests/*.in) and runs every command in its own thread,
+//"join" waits for all of them, so "./test < tests/stress.in" prints the same as tests/stress.out.
+//With -s it also prints to stderr the time of every command type (the time inside the list call).
+//-m mix: synthetic load, -T threads run random operations on keys in [0, -k) for -t seconds, the mix is
+//given with -r insert:remove:contains:range:swap:swap_many (weights, a swap_many op is one call with
+//MIX_SWAP_PAIRS random pairs, so its latency is of the whole batch). With -c we run 1, 2, 4, ... up to -T threads,
+//to get the scaling curve. -o csv prints one line per thread count and operation, so runs of different
+//lock variants (see "make compare") can be kept in one file and compared.
+//Built with STATS=1, -s and every mix run (not in csv) also print the lock and traversal statistics.
+//In a script "swap_many n a1 b1 ... an bn" swaps the n pairs with one swap_many call, and
+//"create_list_from_sorted file" builds the list from the values of the file (sorted, separated by whitespace),
+//like a restart that loads a saved list.
+
+#ifndef LIST_NAME
+#define LIST_NAME "concurrent_list"
+#endif
+#ifndef LIST_SHARDS
+#define LIST_SHARDS 1
+#endif
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_KEYS 10000
+#define DEFAULT_SECONDS 1.0
+#define RANGE_WIDTH 100 //how many keys a range_count of the mix covers.
+#define MIX_SWAP_PAIRS 64 //pairs of a swap_many of the mix (the batched path of concurrent_list starts there).
+#define MAX_THREADS 256
+
+//Latency histogram with 16 buckets per power of two (so every bucket is within 1/16 of its values).
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+#define OP_INSERT 0
+#define OP_REMOVE 1
+#define OP_CONTAINS 2
+#define OP_RANGE 3
+#define OP_SWAP 4
+#define OP_SWAP_MANY 5
+#define OP_PRINT 6
+#define OP_COUNT 7
+#define OP_CREATE 8
+#define OP_DELETE 9
+#define OP_BUILD 10
+#define OP_TYPES 11
+#define MIX_TYPES 6 //the mix only runs the first types (the others print, or change the list itself).
+
+static const char *opNames[OP_TYPES] = {"insert_value", "remove_value", "contains_value", "range_count",
+                                        "swap_values", "swap_many", "print_list", "count_list", "create_list",
+                                        "delete_list", "create_list_from_sorted"};
+
+typedef struct {
+    unsigned long buckets[HIST_BUCKETS];
+    unsigned long count;
+} histogram;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static inline unsigned long now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long) ts.tv_sec * 1000000000UL + (unsigned long) ts.tv_nsec;
+}
+
+static inline int hist_bucket(unsigned long ns) {
+    if (ns < HIST_SUB) {
+        return (int) ns;
+    }
+    int high = 63 - __builtin_clzl(ns); //index of the highest bit, >= HIST_SUB_BITS.
+    int sub = (int) ((ns >> (high - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return (high - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+static unsigned long bucket_value(int bucket) {
+    //The smallest value of the bucket.
+    if (bucket < HIST_SUB) {
+        return (unsigned long) bucket;
+    }
+    int high = bucket / HIST_SUB + HIST_SUB_BITS - 1;
+    unsigned long sub = (unsigned long) (bucket % HIST_SUB);
+    return (HIST_SUB + sub) << (high - HIST_SUB_BITS);
+}
+
+static inline void hist_add(histogram *hist, unsigned long ns) {
+    hist->buckets[hist_bucket(ns)]++;
+    hist->count++;
+}
+
+static inline void hist_add_atomic(histogram *hist, unsigned long ns) {
+    //For the replay, where every command is a thread of its own.
+    __atomic_fetch_add(&hist->buckets[hist_bucket(ns)], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&hist->count, 1, __ATOMIC_RELAXED);
+}
+
+static void hist_merge(histogram *into, const histogram *from) {
+    int i;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        into->buckets[i] += from->buckets[i];
+    }
+    into->count += from->count;
+}
+
+static unsigned long hist_percentile(const histogram *hist, double percentile) {
+    if (hist->count == 0) {
+        return 0;
+    }
+    unsigned long rank = (unsigned long) (percentile / 100 * hist->count);
+    if (rank >= hist->count) {
+        rank = hist->count - 1;
+    }
+    unsigned long seen = 0;
+    int i;
+    for (i = 0; i < HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen > rank) {
+            return bucket_value(i);
+        }
+    }
+    return bucket_value(HIST_BUCKETS - 1);
+}
+
+static void print_latency_header(FILE *out) {
+    fprintf(out, "  %-16s %12s %10s %10s %10s\n", "op", "count", "p50(ns)", "p99(ns)", "p999(ns)");
+}
+
+static void print_latency(FILE *out, const char *name, const histogram *hist) {
+    fprintf(out, "  %-16s %12lu %10lu %10lu %10lu\n", name, hist->count, hist_percentile(hist, 50),
+            hist_percentile(hist, 99), hist_percentile(hist, 99.9));
+}
+
+static void *checked_malloc(size_t size) {
+    void *memory = malloc(size);
+    if (!memory) {
+        //Error with memory allocation.
+        perror("error");
+        exit(1);
+    }
+    return memory;
+}
+
+//---------------------------------------- replay ----------------------------------------
+
+static list *replayList;
+static histogram replayHists[OP_TYPES];
+static int replayTimed;
+
+typedef struct {
+    int op;
+    int value1;
+    int value2;
+    int *values; //swap_many - value1 pairs, create_list_from_sorted - the value1 values of the file.
+} command;
+
+static int count_all(int value) {
+    (void) value;
+    return 1;
+}
+
+static void *run_command(void *arg) {
+    command *cmd = (command *) arg;
+    unsigned long start = replayTimed ? now_ns() : 0;
+    switch (cmd->op) {
+        case OP_CREATE:
+            replayList = create_list();
+            break;
+        case OP_BUILD:
+            replayList = create_list_from_sorted(cmd->values, (size_t) cmd->value1);
+            break;
+        case OP_DELETE:
+            delete_list(replayList);
+            replayList = NULL;
+            break;
+        case OP_INSERT:
+            insert_value(replayList, cmd->value1);
+            break;
+        case OP_REMOVE:
+            remove_value(replayList, cmd->value1);
+            break;
+        case OP_CONTAINS:
+            printf("%d\n", contains_value(replayList, cmd->value1));
+            break;
+        case OP_RANGE:
+            printf("%d\n", range_count(replayList, cmd->value1, cmd->value2));
+            break;
+        case OP_SWAP:
+            swap_values(replayList, cmd->value1, cmd->value2);
+            break;
+        case OP_SWAP_MANY:
+            swap_many(replayList, cmd->values, (size_t) cmd->value1);
+            break;
+        case OP_PRINT:
+            print_list(replayList);
+            break;
+        case OP_COUNT:
+            count_list(replayList, count_all);
+            break;
+    }
+    if (replayTimed) {
+        hist_add_atomic(&replayHists[cmd->op], now_ns() - start);
+    }
+    free(cmd->values);
+    free(cmd);
+    return NULL;
+}
+
+static int read_pairs(command *cmd) {
+    //The value1 pairs of a swap_many, after its count.
+    if (cmd->value1 < 0) {
+        return 0;
+    }
+    cmd->values = (int *) checked_malloc(((size_t) cmd->value1 * 2 + 1) * sizeof(int));
+    int i;
+    for (i = 0; i < cmd->value1 * 2; i++) {
+        if (scanf("%d", &cmd->values[i]) != 1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int read_sorted_file(command *cmd) {
+    //The file name of a create_list_from_sorted, all its values go to cmd->values.
+    char path[256];
+    if (scanf("%255s", path) != 1) {
+        return 0;
+    }
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror(path);
+        return 0;
+    }
+    size_t count = 0;
+    size_t capacity = 1024;
+    cmd->values = (int *) checked_malloc(capacity * sizeof(int));
+    int value;
+    while (fscanf(file, "%d", &value) == 1) {
+        if (count == capacity) {
+            capacity *= 2;
+            cmd->values = (int *) realloc(cmd->values, capacity * sizeof(int));
+            if (!cmd->values) {
+                perror("error");
+                exit(1);
+            }
+        }
+        cmd->values[count++] = value;
+    }
+    int ok = feof(file) && count <= INT_MAX;
+    fclose(file);
+    cmd->value1 = (int) count;
+    return ok;
+}
+
+static int replay(int timed) {
+    pthread_t *threads = NULL;
+    size_t threadCount = 0;
+    size_t threadCapacity = 0;
+    char name[64];
+    int line = 0;
+    int op;
+    replayTimed = timed;
+    double start = now_seconds();
+
+    while (scanf("%63s", name) == 1) {
+        line++;
+        if (strcmp(name, "exit") == 0) {
+            break;
+        }
+        if (strcmp(name, "join") == 0) {
+            size_t i;
+            for (i = 0; i < threadCount; i++) {
+                pthread_join(threads[i], NULL);
+            }
+            threadCount = 0;
+            fflush(stdout);
+            continue;
+        }
+
+        command *cmd = (command *) checked_malloc(sizeof(command));
+        int args = 0;
+        cmd->op = -1;
+        cmd->values = NULL;
+        for (op = 0; op < OP_TYPES; op++) {
+            if (strcmp(name, opNames[op]) == 0) {
+                cmd->op = op;
+            }
+        }
+        if (cmd->op == OP_INSERT || cmd->op == OP_REMOVE || cmd->op == OP_CONTAINS || cmd->op == OP_SWAP_MANY) {
+            args = 1;
+        } else if (cmd->op == OP_RANGE || cmd->op == OP_SWAP) {
+            args = 2;
+        }
+        if (cmd->op < 0 || (args >= 1 && scanf("%d", &cmd->value1) != 1) ||
+            (args == 2 && scanf("%d", &cmd->value2) != 1) || (cmd->op == OP_SWAP_MANY && !read_pairs(cmd)) ||
+            (cmd->op == OP_BUILD && !read_sorted_file(cmd))) {
+            fprintf(stderr, "line %d: bad command %s\n", line, name);
+            free(cmd->values);
+            free(cmd);
+            free(threads);
+            return 1;
+        }
+
+        if (threadCount == threadCapacity) {
+            threadCapacity = threadCapacity ? 2 * threadCapacity : 64;
+            threads = (pthread_t *) realloc(threads, threadCapacity * sizeof(pthread_t));
+            if (!threads) {
+                perror("error");
+                exit(1);
+            }
+        }
+        if (pthread_create(&threads[threadCount], NULL, run_command, cmd) != 0) {
+            perror("error");
+            exit(1);
+        }
+        threadCount++;
+    }
+
+    //A script without a last join still waits for its threads.
+    size_t i;
+    for (i = 0; i < threadCount; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    free(threads);
+    fflush(stdout);
+
+    if (timed) {
+        double elapsed = now_seconds() - start;
+        unsigned long total = 0;
+        fprintf(stderr, "backend: %s, lock: %s, shards: %d\n", LIST_NAME, LIST_LOCK_NAME, LIST_SHARDS);
+        print_latency_header(stderr);
+        for (op = 0; op < OP_TYPES; op++) {
+            if (replayHists[op].count > 0) {
+                print_latency(stderr, opNames[op], &replayHists[op]);
+                total += replayHists[op].count;
+            }
+        }
+        fprintf(stderr, "%lu commands in %.3f s (%.0f commands/s, with the thread creation)\n", total, elapsed,
+                total / elapsed);
+        if (LIST_STATS) {
+            list_stats_print(stderr);
+        }
+    }
+    return 0;
+}
+
+//---------------------------------------- mix ----------------------------------------
+
+typedef struct {
+    int threads;
+    int keys;
+    double seconds;
+    long prefill;
+    int weights[MIX_TYPES];
+    int csv;
+} mix_config;
+
+typedef struct {
+    const mix_config *config;
+    list *list;
+    pthread_barrier_t *barrier;
+    int *stop;
+    unsigned int seed;
+    histogram hists[MIX_TYPES];
+} mix_worker;
+
+static void *run_mix_worker(void *arg) {
+    mix_worker *worker = (mix_worker *) arg;
+    const mix_config *config = worker->config;
+    int totalWeight = 0;
+    int op;
+    for (op = 0; op < MIX_TYPES; op++) {
+        totalWeight += config->weights[op];
+    }
+
+    pthread_barrier_wait(worker->barrier);
+    while (!__atomic_load_n(worker->stop, __ATOMIC_RELAXED)) {
+        int pick = rand_r(&worker->seed) % totalWeight;
+        for (op = 0; pick >= config->weights[op]; op++) {
+            pick -= config->weights[op];
+        }
+        int key = rand_r(&worker->seed) % config->keys;
+        int other = rand_r(&worker->seed) % config->keys;
+        int pairs[2 * MIX_SWAP_PAIRS];
+        if (op == OP_SWAP_MANY) {
+            int i;
+            for (i = 0; i < 2 * MIX_SWAP_PAIRS; i++) {
+                pairs[i] = rand_r(&worker->seed) % config->keys;
+            }
+        }
+
+        unsigned long start = now_ns();
+        switch (op) {
+            case OP_INSERT:
+                insert_value(worker->list, key);
+                break;
+            case OP_REMOVE:
+                remove_value(worker->list, key);
+                break;
+            case OP_CONTAINS:
+                (void) contains_value(worker->list, key);
+                break;
+            case OP_RANGE:
+                (void) range_count(worker->list, key, key + RANGE_WIDTH - 1);
+                break;
+            case OP_SWAP:
+                swap_values(worker->list, key, other);
+                break;
+            case OP_SWAP_MANY:
+                swap_many(worker->list, pairs, MIX_SWAP_PAIRS);
+                break;
+        }
+        hist_add(&worker->hists[op], now_ns() - start);
+    }
+    return NULL;
+}
+
+static double run_mix(const mix_config *config, int threads, double baseRate) {
+    //Returns the ops/sec of this run.
+    list *list = create_list();
+    if (!list) {
+        fprintf(stderr, "create_list failed\n");
+        exit(1);
+    }
+    unsigned int seed = 12345;
+    int *values = (int *) checked_malloc((config->prefill + 1) * sizeof(int));
+    long i;
+    for (i = 0; i < config->prefill; i++) {
+        values[i] = rand_r(&seed) % config->keys;
+    }
+    insert_values(list, values, (size_t) config->prefill);
+    free(values);
+    list_stats_reset(); //only the measured operations.
+
+    mix_worker *workers = (mix_worker *) checked_malloc(threads * sizeof(mix_worker));
+    pthread_t *ids = (pthread_t *) checked_malloc(threads * sizeof(pthread_t));
+    pthread_barrier_t barrier;
+    int stop = 0;
+    pthread_barrier_init(&barrier, NULL, (unsigned) threads + 1);
+    int t;
+    for (t = 0; t < threads; t++) {
+        memset(&workers[t], 0, sizeof(mix_worker));
+        workers[t].config = config;
+        workers[t].list = list;
+        workers[t].barrier = &barrier;
+        workers[t].stop = &stop;
+        workers[t].seed = (unsigned int) (t + 1) * 7919;
+        if (pthread_create(&ids[t], NULL, run_mix_worker, &workers[t]) != 0) {
+            perror("error");
+            exit(1);
+        }
+    }
+
+    pthread_barrier_wait(&barrier);
+    double start = now_seconds();
+    struct timespec sleepTime;
+    sleepTime.tv_sec = (time_t) config->seconds;
+    sleepTime.tv_nsec = (long) ((config->seconds - (double) sleepTime.tv_sec) * 1e9);
+    nanosleep(&sleepTime, NULL);
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    for (t = 0; t < threads; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    double elapsed = now_seconds() - start;
+    pthread_barrier_destroy(&barrier);
+    delete_list(list);
+
+    histogram *total = (histogram *) checked_malloc(MIX_TYPES * sizeof(histogram));
+    memset(total, 0, MIX_TYPES * sizeof(histogram));
+    unsigned long ops = 0;
+    int op;
+    for (op = 0; op < MIX_TYPES; op++) {
+        for (t = 0; t < threads; t++) {
+            hist_merge(&total[op], &workers[t].hists[op]);
+        }
+        ops += total[op].count;
+    }
+    double rate = ops / elapsed;
+
+    if (config->csv) {
+        for (op = 0; op < MIX_TYPES; op++) {
+            if (config->weights[op] > 0) {
+                printf("%s,%s,%d,%d,%d,%s,%lu,%.0f,%lu,%lu,%lu\n", LIST_NAME, LIST_LOCK_NAME, LIST_SHARDS, threads,
+                       config->keys, opNames[op], total[op].count, rate, hist_percentile(&total[op], 50),
+                       hist_percentile(&total[op], 99), hist_percentile(&total[op], 99.9));
+            }
+        }
+    } else {
+        printf("threads: %d, ops: %lu, ops/sec: %.0f", threads, ops, rate);
+        if (baseRate > 0) {
+            printf(", speedup: %.2fx", rate / baseRate);
+        }
+        printf("\n");
+        print_latency_header(stdout);
+        for (op = 0; op < MIX_TYPES; op++) {
+            if (config->weights[op] > 0) {
+                print_latency(stdout, opNames[op], &total[op]);
+            }
+        }
+        if (LIST_STATS) {
+            list_stats_print(stdout);
+        }
+    }
+    fflush(stdout);
+    free(total);
+    free(workers);
+    free(ids);
+    return rate;
+}
+
+static int parse_weights(const char *text, int *weights) {
+    //"insert:remove:contains:range:swap:swap_many", missing weights at the end are 0.
+    int op;
+    for (op = 0; op < MIX_TYPES; op++) {
+        weights[op] = 0;
+    }
+    int total = 0;
+    for (op = 0; op < MIX_TYPES && *text; op++) {
+        char *end;
+        long weight = strtol(text, &end, 10);
+        if (end == text || weight < 0 || (*end && *end != ':')) {
+            return 0;
+        }
+        weights[op] = (int) weight;
+        total += (int) weight;
+        text = *end ? end + 1 : end;
+    }
+    return total > 0 && !*text;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-s] < script\n", name);
+    fprintf(stderr, "       %s -m mix [-T threads] [-k keys] [-t seconds] [-p prefill] "
+                    "[-r insert:remove:contains:range:swap:swap_many] [-c] [-o csv]\n", name);
+}
+
+int main(int argc, char **argv) {
+    mix_config config;
+    config.threads = DEFAULT_THREADS;
+    config.keys = DEFAULT_KEYS;
+    config.seconds = DEFAULT_SECONDS;
+    config.prefill = -1;
+    config.csv = 0;
+    parse_weights("40:40:20", config.weights);
+    int mix = 0;
+    int timed = 0;
+    int curve = 0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0) {
+            timed = 1;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc && strcmp(argv[i + 1], "mix") == 0) {
+            mix = 1;
+            i++;
+        } else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc && strcmp(argv[i + 1], "replay") == 0) {
+            mix = 0;
+            i++;
+        } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0 &&
+                   atoi(argv[i + 1]) <= MAX_THREADS) {
+            config.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc && atoi(argv[i + 1]) > 0) {
+            config.keys = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc && atof(argv[i + 1]) > 0) {
+            config.seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc && atol(argv[i + 1]) >= 0) {
+            config.prefill = atol(argv[++i]);
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc && parse_weights(argv[i + 1], config.weights)) {
+            i++;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            curve = 1;
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc && strcmp(argv[i + 1], "csv") == 0) {
+            config.csv = 1;
+            i++;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!mix) {
+        return replay(timed);
+    }
+
+    if (config.prefill < 0) {
+        config.prefill = config.keys / 2; //with the same insert and remove weights the size stays around that.
+    }
+    if (config.csv) {
+        printf("list,lock,shards,threads,keys,op,count,ops_per_sec,p50_ns,p99_ns,p999_ns\n");
+    } else {
+        printf("backend: %s, lock: %s, shards: %d, keys: %d, prefill: %ld, mix: %d:%d:%d:%d:%d:%d, %.1f s per run\n",
+               LIST_NAME, LIST_LOCK_NAME, LIST_SHARDS, config.keys, config.prefill, config.weights[OP_INSERT],
+               config.weights[OP_REMOVE], config.weights[OP_CONTAINS], config.weights[OP_RANGE],
+               config.weights[OP_SWAP], config.weights[OP_SWAP_MANY], config.seconds);
+    }
+
+    if (!curve) {
+        run_mix(&config, config.threads, 0);
+        return 0;
+    }
+
+    //The scaling curve, the speedup is against the one thread run.
+    int threadCounts[32];
+    double rates[32];
+    int runs = 0;
+    int threads;
+    for (threads = 1; threads < config.threads; threads *= 2) {
+        threadCounts[runs++] = threads;
+    }
+    threadCounts[runs++] = config.threads;
+    for (i = 0; i < runs; i++) {
+        rates[i] = run_mix(&config, threadCounts[i], i > 0 ? rates[0] : 0);
+    }
+    if (!config.csv) {
+        printf("%8s %14s %9s\n", "threads", "ops/sec", "speedup");
+        for (i = 0; i < runs; i++) {
+            printf("%8d %14.0f %8.2fx\n", threadCounts[i], rates[i], rates[i] / rates[0]);
+        }
+    }
+    return 0;
+}
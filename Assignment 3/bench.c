@@ -0,0 +1,270 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "encdec.h"
+#include "encdec_cipher.h"
+#include "encdec_core.h"
+
+//User-space benchmark of the cipher kernels of encdec_cipher.h (see "make bench").
+//First every kernel is checked against the byte loops the driver had - every key with every byte value, and
+//random buffers of every length up to CHECK_LENGTH at every alignment up to 32 (so all the tails run too).
+//Then for every kernel we time caesar write, caesar read and xor over a buffer of -s bytes (default 1MB, it
+//stays in the cache) and print MB/s, with memcpy over the same buffer to compare.
+//Last, the whole path of the devices (encdec_core.c, as the module and encdec_local.c run it) - writes and reads
+//of IO_SIZE bytes per call over a device buffer of -s bytes, with memcpy for copy_to_user/copy_from_user, and
+//ENCDEC_CMD_DECRYPT_RANGE of the whole buffer into the shadow (what a reader of the mmap'ed shadow pays).
+//Build with ARCH_FLAGS=-mavx2 for the AVX2 kernels (SSE2 is always there on x86-64).
+
+#define DEFAULT_SIZE (1 << 20)
+#define DEFAULT_SECONDS 0.2
+#define CHECK_LENGTH 300
+#define IO_SIZE (64 * 1024)
+
+typedef struct {
+    const char *name;
+    void (*caesar)(unsigned char *data, size_t count, encdec_caesar_params params);
+    void (*xor)(unsigned char *data, size_t count, unsigned char key);
+} kernel;
+
+//The loops of the driver, as they were.
+static void loop_caesar_write(char *data, size_t count, unsigned char key) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        data[i] = (data[i] + key) % 128;
+    }
+}
+
+static void loop_caesar_read(char *data, size_t count, unsigned char key) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        data[i] = ((data[i] - key) + 128) % 128;
+    }
+}
+
+static void loop_xor(char *data, size_t count, unsigned char key) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        data[i] = (data[i] ^ key);
+    }
+}
+
+static void bytes_xor(unsigned char *data, size_t count, unsigned char key) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        data[i] ^= key;
+    }
+}
+
+static const kernel kernels[] = {
+        {"bytes", encdec_caesar_bytes, bytes_xor},
+        {"words", encdec_caesar_words, encdec_xor_words},
+#ifdef __SSE2__
+        {"sse2", encdec_caesar_sse2, encdec_xor_sse2},
+#endif
+#ifdef __AVX2__
+        {"avx2", encdec_caesar_avx2, encdec_xor_avx2},
+#endif
+};
+
+#define KERNEL_COUNT ((int) (sizeof(kernels) / sizeof(kernels[0])))
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void run_kernel(const kernel *kernel, int op, unsigned char *data, size_t count, unsigned char key) {
+    //op: 0 caesar write, 1 caesar read, 2 xor.
+    if (op == 2) {
+        kernel->xor(data, count, key);
+    } else {
+        kernel->caesar(data, count, encdec_caesar_params_of(key, op == 1));
+    }
+}
+
+static void run_loop(int op, char *data, size_t count, unsigned char key) {
+    if (op == 0) {
+        loop_caesar_write(data, count, key);
+    } else if (op == 1) {
+        loop_caesar_read(data, count, key);
+    } else {
+        loop_xor(data, count, key);
+    }
+}
+
+static int check_kernel(const kernel *kernel) {
+    static const char *opNames[] = {"caesar write", "caesar read", "xor"};
+    unsigned char expected[CHECK_LENGTH + 32];
+    unsigned char got[CHECK_LENGTH + 32];
+    unsigned int seed = 1;
+    int op;
+    for (op = 0; op < 3; op++) {
+        //Every key with every byte.
+        int key;
+        for (key = 0; key < 256; key++) {
+            int i;
+            for (i = 0; i < 256; i++) {
+                expected[i] = got[i] = (unsigned char) i;
+            }
+            run_loop(op, (char *) expected, 256, (unsigned char) key);
+            run_kernel(kernel, op, got, 256, (unsigned char) key);
+            if (memcmp(expected, got, 256) != 0) {
+                fprintf(stderr, "error: %s %s differs with key %d\n", kernel->name, opNames[op], key);
+                return 1;
+            }
+        }
+        //Every length and alignment, so the tails after the words and the vectors are checked too.
+        size_t length;
+        for (length = 0; length <= CHECK_LENGTH; length++) {
+            int offset;
+            for (offset = 0; offset < 32; offset++) {
+                unsigned char k = (unsigned char) rand_r(&seed);
+                size_t i;
+                for (i = 0; i < sizeof(got); i++) {
+                    expected[i] = got[i] = (unsigned char) rand_r(&seed);
+                }
+                run_loop(op, (char *) expected + offset, length, k);
+                run_kernel(kernel, op, got + offset, length, k);
+                if (memcmp(expected, got, sizeof(got)) != 0) {
+                    fprintf(stderr, "error: %s %s differs with length %zu at offset %d\n", kernel->name,
+                            opNames[op], length, offset);
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static double throughput(const kernel *kernel, int op, unsigned char *data, size_t size, double seconds) {
+    //kernel NULL - the loop of the driver, op -1 - memcpy.
+    static unsigned char *copy = NULL;
+    if (op < 0 && !copy) {
+        copy = malloc(size);
+        if (!copy) {
+            perror("error");
+            exit(1);
+        }
+    }
+    long rounds = 0;
+    double start = now_seconds();
+    double elapsed = 0;
+    while (elapsed < seconds) {
+        unsigned char key = (unsigned char) (rounds * 7 + 3);
+        if (op < 0) {
+            memcpy(copy, data, size);
+        } else if (kernel) {
+            run_kernel(kernel, op, data, size, key);
+        } else {
+            run_loop(op, (char *) data, size, key);
+        }
+        rounds++;
+        elapsed = now_seconds() - start;
+    }
+    return (double) rounds * size / elapsed / 1e6;
+}
+
+static unsigned long copy_local(void *to, const void *from, unsigned long count) {
+    memcpy(to, from, count);
+    return 0;
+}
+
+static double device_throughput(int minor, int op, unsigned char *data, size_t size, double seconds) {
+    //op: 0 write, 1 read raw, 2 read decrypt - of the whole device buffer, IO_SIZE bytes per call,
+    //3 - one ENCDEC_CMD_DECRYPT_RANGE of the whole buffer.
+    static char *shadow = NULL;
+    if (op == 3 && !shadow) {
+        shadow = malloc(size);
+        if (!shadow) {
+            perror("error");
+            exit(1);
+        }
+    }
+    encdec_buffer buffer;
+    buffer.data = (char *) data;
+    buffer.size = size;
+    encdec_private_date privateData;
+    encdec_core_open(&privateData, minor);
+    privateData.shadow = shadow;
+    encdec_core_ioctl(&buffer, &privateData, ENCDEC_CMD_CHANGE_KEY, 13, copy_local);
+    encdec_core_ioctl(&buffer, &privateData, ENCDEC_CMD_SET_READ_STATE,
+                      op == 2 ? ENCDEC_READ_STATE_DECRYPT : ENCDEC_READ_STATE_RAW, copy_local);
+    encdec_range range = {0, size};
+    static char io[IO_SIZE];
+    long long bytes = 0;
+    double start = now_seconds();
+    double elapsed = 0;
+    while (elapsed < seconds) {
+        long long pos = 0;
+        if (op == 3) {
+            encdec_core_ioctl(&buffer, &privateData, ENCDEC_CMD_DECRYPT_RANGE, (unsigned long) &range, copy_local);
+            bytes += size;
+        }
+        while (op != 3 && pos < (long long) size) {
+            ssize_t done = op == 0 ? encdec_core_write(&buffer, &privateData, io, IO_SIZE, &pos, copy_local)
+                                   : encdec_core_read(&buffer, &privateData, io, IO_SIZE, &pos, copy_local);
+            bytes += done;
+        }
+        elapsed = now_seconds() - start;
+    }
+    return bytes / elapsed / 1e6;
+}
+
+int main(int argc, char **argv) {
+    size_t size = DEFAULT_SIZE;
+    double seconds = DEFAULT_SECONDS;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc && atol(argv[i + 1]) > 0) {
+            size = (size_t) atol(argv[++i]);
+        } else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            seconds = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [-s buffer_bytes] [-t seconds_per_kernel]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (i = 0; i < KERNEL_COUNT; i++) {
+        if (check_kernel(&kernels[i])) {
+            return 1;
+        }
+    }
+    printf("all %d kernels are bit-exact with the driver loops\n", KERNEL_COUNT);
+
+    unsigned char *data = malloc(size);
+    if (!data) {
+        perror("error");
+        exit(1);
+    }
+    unsigned int seed = 1;
+    size_t j;
+    for (j = 0; j < size; j++) {
+        data[j] = (unsigned char) rand_r(&seed);
+    }
+
+    printf("buffer: %zu bytes, memcpy: %.0f MB/s\n", size, throughput(NULL, -1, data, size, seconds));
+    printf("%-8s %18s %18s %18s\n", "kernel", "caesar write(MB/s)", "caesar read(MB/s)", "xor(MB/s)");
+    printf("%-8s %18.0f %18.0f %18.0f\n", "loop", throughput(NULL, 0, data, size, seconds),
+           throughput(NULL, 1, data, size, seconds), throughput(NULL, 2, data, size, seconds));
+    for (i = 0; i < KERNEL_COUNT; i++) {
+        printf("%-8s %18.0f %18.0f %18.0f\n", kernels[i].name, throughput(&kernels[i], 0, data, size, seconds),
+               throughput(&kernels[i], 1, data, size, seconds), throughput(&kernels[i], 2, data, size, seconds));
+    }
+
+    printf("devices (encdec_core.c, %d bytes per call):\n", IO_SIZE);
+    printf("%-8s %18s %18s %18s %18s\n", "device", "write(MB/s)", "read raw(MB/s)", "read decrypt(MB/s)",
+           "decrypt range(MB/s)");
+    for (i = 0; i < ENCDEC_DEVICES; i++) {
+        printf("%-8s %18.0f %18.0f %18.0f %18.0f\n", i == 0 ? "caesar" : "xor",
+               device_throughput(i, 0, data, size, seconds), device_throughput(i, 1, data, size, seconds),
+               device_throughput(i, 2, data, size, seconds), device_throughput(i, 3, data, size, seconds));
+    }
+    free(data);
+    return 0;
+}
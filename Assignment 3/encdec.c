@@ -13,6 +13,7 @@
 #include <linux/string.h>
 
 #include "encdec.h"
+#include "encdec_cipher.h"
 
 #define MODULE_NAME "encdec"
 
@@ -205,11 +206,8 @@ ssize_t encdec_read_caesar(struct file *filp, char *buf, size_t count, loff_t *f
     int result = copy_to_user(buf, bufferCaesar + (*f_pos), count);
 
     if (privateData->read_state == ENCDEC_READ_STATE_DECRYPT) {
-        //Decrypt mode - decrypt using the example loop.
-        size_t i;
-        for (i = 0; i < count; i++) {
-            buf[i] = ((buf[i] - privateData->key) + 128) % 128;
-        }
+        //Decrypt mode - the same as ((buf[i] - key) + 128) % 128 on every byte, a word at a time (encdec_cipher.h).
+        encdec_caesar(buf, count, privateData->key, 1);
     }
 
     //Update the new position to be the next "data buffer" minus the not successful read blocks.
@@ -231,10 +229,8 @@ ssize_t encdec_write_caesar(struct file *filp, const char *buf, size_t count, lo
 //    if (result != 0) {
 //        return -ENOSPC;
 //    }
-    size_t i;
-    for (i = 0; i < count - result; i++) {
-        bufferCaesar[i + (*f_pos)] = (bufferCaesar[i + (*f_pos)] + privateData->key) % 128;
-    }
+    //(bufferCaesar[i] + key) % 128 on every byte we got, a word at a time (encdec_cipher.h).
+    encdec_caesar(bufferCaesar + (*f_pos), count - result, privateData->key, 0);
 
     //Update the new position to be the next "data buffer" minus the not successful read blocks.
     *f_pos = *f_pos + count - result;
@@ -252,11 +248,8 @@ ssize_t encdec_read_xor(struct file *filp, char *buf, size_t count, loff_t *f_po
     int result = copy_to_user(buf, bufferXor + (*f_pos), count);
 
     if (privateData->read_state == ENCDEC_READ_STATE_DECRYPT) {
-        //Decrypt mode - decrypt using the example loop.
-        size_t i;
-        for ( i= 0; i < count; i++) {
-            buf[i] = (buf[i] ^ privateData->key);
-        }
+        //Decrypt mode - xor every byte with the key, a word at a time (encdec_cipher.h).
+        encdec_xor(buf, count, privateData->key);
     }
 
     //Update the new position to be the next "data buffer" minus the not successful read blocks.
@@ -279,10 +272,7 @@ ssize_t encdec_write_xor(struct file *filp, const char *buf, size_t count, loff_
 //    if (result != 0) {
 //        return -ENOSPC;
 //    }
-    size_t i;
-    for (i = 0; i < count - result; i++) {
-        bufferXor[i + (*f_pos)] = (bufferXor[i + (*f_pos)] ^ privateData->key);
-    }
+    encdec_xor(bufferXor + (*f_pos), count - result, privateData->key);
 
     //Update the new position to be the next "data buffer" minus the not successful read blocks.
     *f_pos = *f_pos + count - result;
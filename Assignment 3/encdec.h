@@ -4,8 +4,20 @@
 #define ENCDEC_CMD_CHANGE_KEY		0
 #define ENCDEC_CMD_SET_READ_STATE	1
 #define ENCDEC_CMD_ZERO				2
+#define ENCDEC_CMD_DECRYPT_RANGE	3 //arg - a pointer to an encdec_range.
 
 #define ENCDEC_READ_STATE_RAW		0
 #define ENCDEC_READ_STATE_DECRYPT	1
 
+//mmap offsets (read only mappings): 0 - the buffer of the device as it is (raw, encrypted),
+//ENCDEC_MMAP_SHADOW - the shadow buffer of the open file, ENCDEC_CMD_DECRYPT_RANGE decrypts into it.
+#define ENCDEC_MMAP_SHADOW			0x40000000
+
+//Decrypts the bytes [offset, offset + length) of the buffer with the key of the file, into the same place
+//in the shadow - after that, reading them from the mapped shadow costs no syscalls.
+typedef struct {
+    unsigned long offset;
+    unsigned long length;
+} encdec_range;
+
 #endif
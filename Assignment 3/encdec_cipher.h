@@ -0,0 +1,186 @@
+#ifndef _ENCDEC_CIPHER_H_
+#define _ENCDEC_CIPHER_H_
+
+//The cipher kernels of the driver. They are in a header so the module (one object) and the user-space
+//benchmark (bench.c, "make bench") compile the very same code.
+//They are bit-exact with the byte loops the driver had, on a (signed) char b:
+//  caesar write: b = (b + key) % 128, caesar read: b = ((b - key) + 128) % 128, xor: b = b ^ key
+//With C's % a negative sum stays negative, so the bytes >= 128 don't simply wrap around. For every byte u
+//(unsigned) both caesar directions come down to m = (u + add) & 127, and the byte is m | 128 if (u ^ 128) < below
+//and m != 0, m otherwise (see encdec_caesar_params for add and below). That is a masked add with no carries
+//between the bytes, so it runs an unsigned long at a time in the kernel, and 16 (SSE2) or 32 (AVX2) bytes at a
+//time in user space (the kernel code can't touch the vector registers without saving them first).
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/string.h>
+#else
+#include <stddef.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+#endif
+
+typedef struct {
+    unsigned char add; //0..127
+    unsigned int below; //0..255, 0 - never
+} encdec_caesar_params;
+
+#define ENCDEC_ONES (~0UL / 255) //0x0101...01
+#define ENCDEC_LOW (ENCDEC_ONES * 127)
+#define ENCDEC_HIGH (ENCDEC_ONES * 128)
+
+static inline encdec_caesar_params encdec_caesar_params_of(unsigned char key, int decrypt) {
+    //Write: a negative sum (b + key < 0) is a byte >= 128 with u + key < 256, that is (u ^ 128) < 128 - key.
+    //Read: ((b - key) + 128) < 0 is (u ^ 128) < key.
+    encdec_caesar_params params;
+    if (decrypt) {
+        params.add = (unsigned char) (-key & 127);
+        params.below = key;
+    } else {
+        params.add = (unsigned char) (key & 127);
+        params.below = key < 128 ? 128 - key : 0;
+    }
+    return params;
+}
+
+static inline unsigned char encdec_caesar_byte(unsigned char u, encdec_caesar_params params) {
+    unsigned char m = (unsigned char) ((u + params.add) & 127);
+    return (unsigned char) ((unsigned int) (u ^ 128) < params.below && m ? m | 128 : m);
+}
+
+static inline void encdec_caesar_bytes(unsigned char *data, size_t count, encdec_caesar_params params) {
+    size_t i;
+    for (i = 0; i < count; i++) {
+        data[i] = encdec_caesar_byte(data[i], params);
+    }
+}
+
+static inline unsigned long encdec_caesar_word(unsigned long w, unsigned long add, unsigned long belowLow,
+                                               int belowHigh) {
+    //Every byte of a word on its own - the sums stay below 256, so nothing carries into the next byte.
+    unsigned long m = ((w & ENCDEC_LOW) + add) & ENCDEC_LOW;
+    unsigned long lessLow = ~((w | ENCDEC_HIGH) - belowLow) & ENCDEC_HIGH; //low 7 bits of u < those of below
+    unsigned long less = belowHigh ? (w & ENCDEC_HIGH) | lessLow : w & lessLow; //(u ^ 128) < below
+    unsigned long nonZero = (m + ENCDEC_LOW) & ENCDEC_HIGH;
+    return m | (less & nonZero);
+}
+
+static inline void encdec_caesar_words(unsigned char *data, size_t count, encdec_caesar_params params) {
+    unsigned long add = ENCDEC_ONES * params.add;
+    unsigned long belowLow = ENCDEC_ONES * (params.below & 127);
+    int belowHigh = params.below >= 128;
+    size_t i;
+    for (i = 0; i + sizeof(unsigned long) <= count; i += sizeof(unsigned long)) {
+        unsigned long w;
+        memcpy(&w, data + i, sizeof(w)); //the buffers don't have to be aligned.
+        w = encdec_caesar_word(w, add, belowLow, belowHigh);
+        memcpy(data + i, &w, sizeof(w));
+    }
+    encdec_caesar_bytes(data + i, count - i, params);
+}
+
+static inline void encdec_xor_words(unsigned char *data, size_t count, unsigned char key) {
+    unsigned long mask = ENCDEC_ONES * key;
+    size_t i;
+    for (i = 0; i + sizeof(unsigned long) <= count; i += sizeof(unsigned long)) {
+        unsigned long w;
+        memcpy(&w, data + i, sizeof(w));
+        w ^= mask;
+        memcpy(data + i, &w, sizeof(w));
+    }
+    for (; i < count; i++) {
+        data[i] ^= key;
+    }
+}
+
+#if !defined(__KERNEL__) && defined(__SSE2__)
+static inline void encdec_caesar_sse2(unsigned char *data, size_t count, encdec_caesar_params params) {
+    //encdec_caesar_word, 16 bytes at a time.
+    __m128i add = _mm_set1_epi8((char) params.add);
+    __m128i belowLow = _mm_set1_epi8((char) (params.below & 127));
+    __m128i low = _mm_set1_epi8(127);
+    __m128i high = _mm_set1_epi8((char) 128);
+    int belowHigh = params.below >= 128;
+    size_t i;
+    for (i = 0; i + 16 <= count; i += 16) {
+        __m128i w = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i m = _mm_and_si128(_mm_add_epi8(_mm_and_si128(w, low), add), low);
+        __m128i lessLow = _mm_andnot_si128(_mm_sub_epi8(_mm_or_si128(w, high), belowLow), high);
+        __m128i less = belowHigh ? _mm_or_si128(_mm_and_si128(w, high), lessLow) : _mm_and_si128(w, lessLow);
+        __m128i nonZero = _mm_and_si128(_mm_add_epi8(m, low), high);
+        _mm_storeu_si128((__m128i *) (data + i), _mm_or_si128(m, _mm_and_si128(less, nonZero)));
+    }
+    encdec_caesar_words(data + i, count - i, params);
+}
+
+static inline void encdec_xor_sse2(unsigned char *data, size_t count, unsigned char key) {
+    __m128i mask = _mm_set1_epi8((char) key);
+    size_t i;
+    for (i = 0; i + 16 <= count; i += 16) {
+        __m128i w = _mm_loadu_si128((const __m128i *) (data + i));
+        _mm_storeu_si128((__m128i *) (data + i), _mm_xor_si128(w, mask));
+    }
+    encdec_xor_words(data + i, count - i, key);
+}
+#endif
+
+#if !defined(__KERNEL__) && defined(__AVX2__)
+static inline void encdec_caesar_avx2(unsigned char *data, size_t count, encdec_caesar_params params) {
+    //encdec_caesar_word, 32 bytes at a time.
+    __m256i add = _mm256_set1_epi8((char) params.add);
+    __m256i belowLow = _mm256_set1_epi8((char) (params.below & 127));
+    __m256i low = _mm256_set1_epi8(127);
+    __m256i high = _mm256_set1_epi8((char) 128);
+    int belowHigh = params.below >= 128;
+    size_t i;
+    for (i = 0; i + 32 <= count; i += 32) {
+        __m256i w = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i m = _mm256_and_si256(_mm256_add_epi8(_mm256_and_si256(w, low), add), low);
+        __m256i lessLow = _mm256_andnot_si256(_mm256_sub_epi8(_mm256_or_si256(w, high), belowLow), high);
+        __m256i less = belowHigh ? _mm256_or_si256(_mm256_and_si256(w, high), lessLow)
+                                 : _mm256_and_si256(w, lessLow);
+        __m256i nonZero = _mm256_and_si256(_mm256_add_epi8(m, low), high);
+        _mm256_storeu_si256((__m256i *) (data + i), _mm256_or_si256(m, _mm256_and_si256(less, nonZero)));
+    }
+    encdec_caesar_sse2(data + i, count - i, params);
+}
+
+static inline void encdec_xor_avx2(unsigned char *data, size_t count, unsigned char key) {
+    __m256i mask = _mm256_set1_epi8((char) key);
+    size_t i;
+    for (i = 0; i + 32 <= count; i += 32) {
+        __m256i w = _mm256_loadu_si256((const __m256i *) (data + i));
+        _mm256_storeu_si256((__m256i *) (data + i), _mm256_xor_si256(w, mask));
+    }
+    encdec_xor_sse2(data + i, count - i, key);
+}
+#endif
+
+//What the driver calls - the widest kernel this build has.
+static inline void encdec_caesar(char *data, size_t count, unsigned char key, int decrypt) {
+    encdec_caesar_params params = encdec_caesar_params_of(key, decrypt);
+#if !defined(__KERNEL__) && defined(__AVX2__)
+    encdec_caesar_avx2((unsigned char *) data, count, params);
+#elif !defined(__KERNEL__) && defined(__SSE2__)
+    encdec_caesar_sse2((unsigned char *) data, count, params);
+#else
+    encdec_caesar_words((unsigned char *) data, count, params);
+#endif
+}
+
+static inline void encdec_xor(char *data, size_t count, unsigned char key) {
+#if !defined(__KERNEL__) && defined(__AVX2__)
+    encdec_xor_avx2((unsigned char *) data, count, key);
+#elif !defined(__KERNEL__) && defined(__SSE2__)
+    encdec_xor_sse2((unsigned char *) data, count, key);
+#else
+    encdec_xor_words((unsigned char *) data, count, key);
+#endif
+}
+
+#endif
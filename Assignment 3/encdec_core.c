@@ -0,0 +1,114 @@
+#ifdef __KERNEL__
+#include <linux/errno.h>
+#include <linux/string.h>
+#else
+#include <errno.h>
+#include <string.h>
+#endif
+
+#include "encdec.h"
+#include "encdec_cipher.h"
+#include "encdec_core.h"
+
+#define ENCDEC_CHUNK 512 //bytes we decrypt at a time before copying them out (it is on the kernel stack).
+
+int encdec_core_open(encdec_private_date *privateData, int minor) {
+    if (minor < 0 || minor >= ENCDEC_DEVICES) {
+        return -EINVAL;
+    }
+    privateData->minor = minor;
+    privateData->key = 0;
+    privateData->read_state = ENCDEC_READ_STATE_DECRYPT; //Default value, same as the 2.4 driver.
+    privateData->shadow = NULL;
+    return 0;
+}
+
+static void decrypt(encdec_private_date *privateData, char *data, size_t count) {
+    if (privateData->minor == 0) {
+        encdec_caesar(data, count, privateData->key, 1);
+    } else {
+        encdec_xor(data, count, privateData->key);
+    }
+}
+
+static int decrypt_range(encdec_buffer *buffer, encdec_private_date *privateData, unsigned long arg,
+                         encdec_copy copyIn) {
+    encdec_range range;
+    if (copyIn(&range, (const void *) arg, sizeof(range))) {
+        return -EFAULT;
+    }
+    if (!privateData->shadow || range.offset > buffer->size || range.length > buffer->size - range.offset) {
+        return -EINVAL;
+    }
+    memcpy(privateData->shadow + range.offset, buffer->data + range.offset, range.length);
+    decrypt(privateData, privateData->shadow + range.offset, range.length);
+    return 0;
+}
+
+int encdec_core_ioctl(encdec_buffer *buffer, encdec_private_date *privateData, unsigned int cmd, unsigned long arg,
+                      encdec_copy copyIn) {
+    if (cmd == ENCDEC_CMD_CHANGE_KEY) {
+        privateData->key = (unsigned char) arg;
+    } else if (cmd == ENCDEC_CMD_SET_READ_STATE) {
+        privateData->read_state = (int) arg;
+    } else if (cmd == ENCDEC_CMD_ZERO) {
+        memset(buffer->data, 0, buffer->size);
+    } else if (cmd == ENCDEC_CMD_DECRYPT_RANGE) {
+        return decrypt_range(buffer, privateData, arg, copyIn);
+    } else {
+        return -ENOTTY;
+    }
+    return 0;
+}
+
+ssize_t encdec_core_read(encdec_buffer *buffer, encdec_private_date *privateData, char *to, size_t count,
+                         long long *pos, encdec_copy copyOut) {
+    const char *from;
+    size_t done = 0;
+    if (*pos < 0 || *pos >= (long long) buffer->size) {
+        return -EINVAL;
+    }
+    if (count > buffer->size - *pos) {
+        count = buffer->size - *pos;
+    }
+    from = buffer->data + *pos;
+    if (privateData->read_state != ENCDEC_READ_STATE_DECRYPT) {
+        done = count - copyOut(to, from, count);
+    } else {
+        char chunk[ENCDEC_CHUNK];
+        while (done < count) {
+            size_t length = count - done < ENCDEC_CHUNK ? count - done : ENCDEC_CHUNK;
+            unsigned long left;
+            memcpy(chunk, from + done, length);
+            decrypt(privateData, chunk, length);
+            left = copyOut(to + done, chunk, length);
+            done += length - left;
+            if (left) {
+                break;
+            }
+        }
+    }
+    *pos += done;
+    return (ssize_t) done;
+}
+
+ssize_t encdec_core_write(encdec_buffer *buffer, encdec_private_date *privateData, const char *from, size_t count,
+                          long long *pos, encdec_copy copyIn) {
+    char *to;
+    size_t done;
+    if (*pos < 0 || *pos >= (long long) buffer->size) {
+        return -ENOSPC;
+    }
+    if (count > buffer->size - *pos) {
+        count = buffer->size - *pos;
+    }
+    to = buffer->data + *pos;
+    done = count - copyIn(to, from, count);
+    if (privateData->minor == 0) {
+        encdec_caesar(to, done, privateData->key, 0);
+    } else {
+        encdec_xor(to, done, privateData->key);
+    }
+    *pos += done;
+    return (ssize_t) done;
+}
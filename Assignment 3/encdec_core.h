@@ -0,0 +1,65 @@
+#ifndef _ENCDEC_CORE_H_
+#define _ENCDEC_CORE_H_
+
+//The part of encdec that doesn't depend on the kernel - the buffers of the two devices and what open, read,
+//write and ioctl do to them. It is linked into the module for current kernels (encdec_module.c) and into the
+//user-space stand-in (encdec_local.c), the only thing they give it is how to copy from/to the caller
+//(copy_from_user/copy_to_user, or memcpy). encdec.c is still the 2.4 driver on its own.
+//Unlike the 2.4 driver, read and write stop at the end of the buffer, and decrypting happens in a buffer of ours
+//before the bytes are copied out (the caller's buffer is only written by the copy).
+//For mmap the buffers (and the shadows, see ENCDEC_CMD_DECRYPT_RANGE) are whole pages, the glue allocates them
+//(vmalloc_user, or a memfd in user space) - the core only uses the first size bytes.
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#else
+#include <stddef.h>
+#include <sys/types.h>
+#endif
+
+#define ENCDEC_DEVICES 2 //minor 0 - caesar, minor 1 - xor.
+
+typedef struct {
+    char *data;
+    size_t size;
+} encdec_buffer;
+
+//The private data of an open file.
+typedef struct {
+    unsigned char key;
+    int read_state;
+    int minor;
+    char *shadow; //decrypted copy of the buffer for mmap, NULL until the glue allocates it.
+} encdec_private_date;
+
+//Like copy_to_user/copy_from_user - copies count bytes, returns how many of them were NOT copied.
+typedef unsigned long (*encdec_copy)(void *to, const void *from, unsigned long count);
+
+/**
+ * @return 0, -EINVAL if the minor is not one of ours.
+ */
+int encdec_core_open(encdec_private_date *privateData, int minor);
+
+/**
+ * ENCDEC_CMD_CHANGE_KEY, ENCDEC_CMD_SET_READ_STATE, ENCDEC_CMD_ZERO (of the buffer of the file's device) or
+ * ENCDEC_CMD_DECRYPT_RANGE (the glue allocates the shadow before, arg is copied in with copyIn).
+ * @return 0, -EFAULT / -EINVAL for a bad range, -ENOTTY for any other command.
+ */
+int encdec_core_ioctl(encdec_buffer *buffer, encdec_private_date *privateData, unsigned int cmd, unsigned long arg,
+                      encdec_copy copyIn);
+
+/**
+ * Reads from *pos (decrypted in ENCDEC_READ_STATE_DECRYPT), and moves *pos on.
+ * @return the bytes that were copied to the caller, -EINVAL if *pos is not in the buffer.
+ */
+ssize_t encdec_core_read(encdec_buffer *buffer, encdec_private_date *privateData, char *to, size_t count,
+                         long long *pos, encdec_copy copyOut);
+
+/**
+ * Writes at *pos (encrypted), and moves *pos on.
+ * @return the bytes that were copied from the caller, -ENOSPC if *pos is not in the buffer.
+ */
+ssize_t encdec_core_write(encdec_buffer *buffer, encdec_private_date *privateData, const char *from, size_t count,
+                          long long *pos, encdec_copy copyIn);
+
+#endif
@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "encdec.h"
+#include "encdec_core.h"
+
+//User-space stand-in for /dev/encdec0 and /dev/encdec1, for hosts where the module can't be loaded.
+//Build it as a library and preload it: "LD_PRELOAD=./libencdec_local.so ./test_local < tests/test1.in"
+//(see "make check"). It takes over open of the two device paths and read, write, lseek, ioctl, mmap and close of
+//the fds it returned, everything else goes to libc. The devices run encdec_core.c, like the module does, with a
+//buffer of ENCDEC_MEMORY_SIZE bytes (default 50, as in ./load) - it lives as long as the process.
+//An fd of ours is a real fd of /dev/null, so its number is not given to anything else while it is open.
+//The buffers and the shadows are memfds (mapped for the core), so mmap of our fd gives a real shared mapping of
+//them, that sees every later write - and munmap is the one of libc.
+
+#define DEFAULT_MEMORY_SIZE 50
+#define LOCAL_MAX_FDS 1024
+
+typedef struct {
+    encdec_private_date privateData;
+    long long pos;
+    int flags;
+    int shadowFd; //-1 until the shadow is allocated.
+} local_file;
+
+static encdec_buffer buffers[ENCDEC_DEVICES];
+static int bufferFds[ENCDEC_DEVICES];
+static size_t mappedSize; //the size of the buffers rounded up to pages.
+static local_file *files[LOCAL_MAX_FDS];
+static pthread_mutex_t shadowMutex = PTHREAD_MUTEX_INITIALIZER; //threads that share an fd allocate one shadow.
+
+static int (*realOpen)(const char *path, int flags, ...);
+static int (*realClose)(int fd);
+static ssize_t (*realRead)(int fd, void *buf, size_t count);
+static ssize_t (*realWrite)(int fd, const void *buf, size_t count);
+static off_t (*realLseek)(int fd, off_t offset, int whence);
+static int (*realIoctl)(int fd, unsigned long request, ...);
+static void *(*realMmap)(void *addr, size_t length, int prot, int flags, int fd, off_t offset);
+
+static char *map_memfd(const char *name, int *fd) {
+    //A memfd of mappedSize bytes (zeroed), mapped for us.
+    *fd = memfd_create(name, MFD_CLOEXEC);
+    if (*fd < 0 || ftruncate(*fd, (off_t) mappedSize) < 0) {
+        return NULL;
+    }
+    char *data = realMmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+    return data == MAP_FAILED ? NULL : data;
+}
+
+__attribute__((constructor)) static void local_init(void) {
+    realOpen = dlsym(RTLD_NEXT, "open");
+    realClose = dlsym(RTLD_NEXT, "close");
+    realRead = dlsym(RTLD_NEXT, "read");
+    realWrite = dlsym(RTLD_NEXT, "write");
+    realLseek = dlsym(RTLD_NEXT, "lseek");
+    realIoctl = dlsym(RTLD_NEXT, "ioctl");
+    realMmap = dlsym(RTLD_NEXT, "mmap");
+
+    const char *sizeVariable = getenv("ENCDEC_MEMORY_SIZE");
+    size_t size = sizeVariable && atol(sizeVariable) > 0 ? (size_t) atol(sizeVariable) : DEFAULT_MEMORY_SIZE;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    mappedSize = (size + pageSize - 1) / pageSize * pageSize;
+    int i;
+    for (i = 0; i < ENCDEC_DEVICES; i++) {
+        buffers[i].data = map_memfd("encdec", &bufferFds[i]);
+        buffers[i].size = size;
+        if (!buffers[i].data) {
+            perror("error");
+            exit(1);
+        }
+    }
+}
+
+static unsigned long copy_local(void *to, const void *from, unsigned long count) {
+    memcpy(to, from, count);
+    return 0;
+}
+
+static local_file *find_file(int fd) {
+    return fd >= 0 && fd < LOCAL_MAX_FDS ? files[fd] : NULL;
+}
+
+static int alloc_shadow(local_file *file) {
+    int result = 0;
+    pthread_mutex_lock(&shadowMutex);
+    if (file->shadowFd < 0) {
+        char *shadow = map_memfd("encdec-shadow", &file->shadowFd);
+        if (shadow) {
+            file->privateData.shadow = shadow;
+        } else {
+            if (file->shadowFd >= 0) {
+                realClose(file->shadowFd);
+                file->shadowFd = -1;
+            }
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&shadowMutex);
+    return result;
+}
+
+static int device_minor(const char *path) {
+    if (strcmp(path, "/dev/encdec0") == 0) {
+        return 0;
+    }
+    if (strcmp(path, "/dev/encdec1") == 0) {
+        return 1;
+    }
+    return -1;
+}
+
+static ssize_t result(ssize_t value) {
+    //The core returns -errno, like the kernel does.
+    if (value < 0) {
+        errno = (int) -value;
+        return -1;
+    }
+    return value;
+}
+
+int open(const char *path, int flags, ...) {
+    mode_t mode = 0;
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    int minor = device_minor(path);
+    if (minor < 0) {
+        return realOpen(path, flags, mode);
+    }
+    int fd = realOpen("/dev/null", O_RDWR | (flags & O_CLOEXEC));
+    if (fd < 0) {
+        return fd;
+    }
+    if (fd >= LOCAL_MAX_FDS) {
+        realClose(fd);
+        errno = EMFILE;
+        return -1;
+    }
+    local_file *file = calloc(1, sizeof(local_file));
+    if (!file) {
+        realClose(fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    encdec_core_open(&file->privateData, minor);
+    file->flags = flags;
+    file->shadowFd = -1;
+    files[fd] = file;
+    return fd;
+}
+
+int open64(const char *path, int flags, ...) {
+    mode_t mode = 0;
+    if (flags & (O_CREAT | O_TMPFILE)) {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, mode_t);
+        va_end(args);
+    }
+    return open(path, flags, mode);
+}
+
+int close(int fd) {
+    local_file *file = find_file(fd);
+    if (file) {
+        //Mappings of the shadow keep the memfd on their own.
+        if (file->shadowFd >= 0) {
+            munmap(file->privateData.shadow, mappedSize);
+            realClose(file->shadowFd);
+        }
+        free(file);
+        files[fd] = NULL;
+    }
+    return realClose(fd);
+}
+
+ssize_t read(int fd, void *buf, size_t count) {
+    local_file *file = find_file(fd);
+    if (!file) {
+        return realRead(fd, buf, count);
+    }
+    if ((file->flags & O_ACCMODE) == O_WRONLY) {
+        errno = EBADF;
+        return -1;
+    }
+    return result(encdec_core_read(&buffers[file->privateData.minor], &file->privateData, buf, count, &file->pos,
+                                   copy_local));
+}
+
+ssize_t write(int fd, const void *buf, size_t count) {
+    local_file *file = find_file(fd);
+    if (!file) {
+        return realWrite(fd, buf, count);
+    }
+    if ((file->flags & O_ACCMODE) == O_RDONLY) {
+        errno = EBADF;
+        return -1;
+    }
+    return result(encdec_core_write(&buffers[file->privateData.minor], &file->privateData, buf, count, &file->pos,
+                                    copy_local));
+}
+
+off_t lseek(int fd, off_t offset, int whence) {
+    //As default_llseek for a device (its size is 0, so SEEK_END is from 0).
+    local_file *file = find_file(fd);
+    if (!file) {
+        return realLseek(fd, offset, whence);
+    }
+    long long pos;
+    if (whence == SEEK_SET || whence == SEEK_END) {
+        pos = offset;
+    } else if (whence == SEEK_CUR) {
+        pos = file->pos + offset;
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+    if (pos < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    file->pos = pos;
+    return (off_t) pos;
+}
+
+off_t lseek64(int fd, off_t offset, int whence) {
+    return lseek(fd, offset, whence);
+}
+
+int ioctl(int fd, unsigned long request, ...) {
+    va_list args;
+    va_start(args, request);
+    unsigned long arg = va_arg(args, unsigned long);
+    va_end(args);
+    local_file *file = find_file(fd);
+    if (!file) {
+        return realIoctl(fd, request, arg);
+    }
+    if (request == ENCDEC_CMD_DECRYPT_RANGE && alloc_shadow(file) < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+    return (int) result(encdec_core_ioctl(&buffers[file->privateData.minor], &file->privateData,
+                                          (unsigned int) request, arg, copy_local));
+}
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    //As encdec_mmap of the module - read only, offset 0 or ENCDEC_MMAP_SHADOW, no longer than the pages.
+    local_file *file = find_file(fd);
+    if (!file) {
+        return realMmap(addr, length, prot, flags, fd, offset);
+    }
+    int target;
+    if ((prot & PROT_WRITE) || (file->flags & O_ACCMODE) == O_WRONLY) {
+        errno = EACCES;
+        return MAP_FAILED;
+    }
+    if (length > mappedSize) {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    if (offset == 0) {
+        target = bufferFds[file->privateData.minor];
+    } else if (offset == ENCDEC_MMAP_SHADOW) {
+        if (alloc_shadow(file) < 0) {
+            errno = ENOMEM;
+            return MAP_FAILED;
+        }
+        target = file->shadowFd;
+    } else {
+        errno = EINVAL;
+        return MAP_FAILED;
+    }
+    return realMmap(addr, length, prot, flags, target, 0);
+}
+
+void *mmap64(void *addr, size_t length, int prot, int flags, int fd, off_t offset) {
+    return mmap(addr, length, prot, flags, fd, offset);
+}
@@ -0,0 +1,181 @@
+#include <linux/atomic.h>
+#include <linux/fs.h>
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/vmalloc.h>
+
+#include "encdec.h"
+#include "encdec_core.h"
+
+//encdec for current kernels (the 2.4 one is encdec.c), the devices themselves are in encdec_core.c.
+//Built with Kbuild ("make module"), it is loaded with ./load as well - the same memory_size and device names.
+//The buffers are vmalloc_user pages (memory_size rounded up to a page), so mmap can map them as they are - read
+//only, see ENCDEC_MMAP_SHADOW in encdec.h for the offsets.
+
+#define MODULE_NAME "encdec"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("YOUR NAME");
+
+static int memory_size = 0;
+module_param(memory_size, int, 0444);
+
+static int major = 0;
+
+//buffers[0] - caesar (minor 0), buffers[1] - xor (minor 1).
+static encdec_buffer buffers[ENCDEC_DEVICES];
+
+static unsigned long copy_out(void *to, const void *from, unsigned long count) {
+    return copy_to_user((void __user *) to, from, count);
+}
+
+static unsigned long copy_in(void *to, const void *from, unsigned long count) {
+    return copy_from_user(to, (const void __user *) from, count);
+}
+
+static int encdec_open(struct inode *inode, struct file *filp) {
+    encdec_private_date *privateData = kmalloc(sizeof(encdec_private_date), GFP_KERNEL);
+    int result;
+    if (!privateData) {
+        return -ENOMEM;
+    }
+    result = encdec_core_open(privateData, iminor(inode));
+    if (result < 0) {
+        kfree(privateData);
+        return result;
+    }
+    filp->private_data = privateData;
+    return 0;
+}
+
+static int encdec_release(struct inode *inode, struct file *filp) {
+    //A mapping holds the file, so nothing is mapped from the shadow anymore.
+    encdec_private_date *privateData = filp->private_data;
+    vfree(privateData->shadow);
+    kfree(privateData);
+    return 0;
+}
+
+static encdec_buffer *buffer_of(struct file *filp) {
+    encdec_private_date *privateData = filp->private_data;
+    return &buffers[privateData->minor];
+}
+
+static int alloc_shadow(struct file *filp) {
+    //Threads can share the file, so the shadow is published with cmpxchg - if another thread was first,
+    //we free ours and everybody uses (and maps) the one that won. Once set it never changes.
+    encdec_private_date *privateData = filp->private_data;
+    char *shadow;
+    if (READ_ONCE(privateData->shadow)) {
+        return 0;
+    }
+    shadow = vmalloc_user(PAGE_ALIGN(buffer_of(filp)->size));
+    if (!shadow) {
+        return -ENOMEM;
+    }
+    if (cmpxchg(&privateData->shadow, NULL, shadow) != NULL) {
+        vfree(shadow);
+    }
+    return 0;
+}
+
+static long encdec_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
+    if (cmd == ENCDEC_CMD_DECRYPT_RANGE) {
+        int result = alloc_shadow(filp);
+        if (result < 0) {
+            return result;
+        }
+    }
+    return encdec_core_ioctl(buffer_of(filp), filp->private_data, cmd, arg, copy_in);
+}
+
+static int encdec_mmap(struct file *filp, struct vm_area_struct *vma) {
+    //Offset 0 - the buffer of the device, ENCDEC_MMAP_SHADOW - the shadow of this file. Writing to them would skip
+    //the cipher, so both are read only.
+    encdec_private_date *privateData = filp->private_data;
+    unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+    void *area;
+    if (vma->vm_flags & VM_WRITE) {
+        return -EACCES;
+    }
+    if (offset == 0) {
+        area = buffer_of(filp)->data;
+    } else if (offset == ENCDEC_MMAP_SHADOW) {
+        int result = alloc_shadow(filp);
+        if (result < 0) {
+            return result;
+        }
+        area = privateData->shadow;
+    } else {
+        return -EINVAL;
+    }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+    //Fails with -EINVAL if the mapping is longer than the pages of the area.
+    return remap_vmalloc_range(vma, area, 0);
+}
+
+static ssize_t encdec_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos) {
+    return encdec_core_read(buffer_of(filp), filp->private_data, (char __force *) buf, count, f_pos, copy_out);
+}
+
+static ssize_t encdec_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos) {
+    return encdec_core_write(buffer_of(filp), filp->private_data, (const char __force *) buf, count, f_pos, copy_in);
+}
+
+//One file_operations for both devices - the core knows the cipher from the minor.
+static const struct file_operations fops = {
+        .owner = THIS_MODULE,
+        .open = encdec_open,
+        .release = encdec_release,
+        .read = encdec_read,
+        .write = encdec_write,
+        .llseek = default_llseek,
+        .unlocked_ioctl = encdec_ioctl,
+        .mmap = encdec_mmap,
+};
+
+static void free_buffers(void) {
+    int i;
+    for (i = 0; i < ENCDEC_DEVICES; i++) {
+        vfree(buffers[i].data);
+        buffers[i].data = NULL;
+    }
+}
+
+static int __init encdec_init(void) {
+    int i;
+    if (memory_size <= 0) {
+        return -EINVAL;
+    }
+    for (i = 0; i < ENCDEC_DEVICES; i++) {
+        buffers[i].data = vmalloc_user(PAGE_ALIGN(memory_size)); //zeroed.
+        buffers[i].size = memory_size;
+        if (!buffers[i].data) {
+            free_buffers();
+            return -ENOMEM;
+        }
+    }
+    major = register_chrdev(0, MODULE_NAME, &fops);
+    if (major < 0) {
+        free_buffers();
+        return major;
+    }
+    return 0;
+}
+
+static void __exit encdec_exit(void) {
+    unregister_chrdev(major, MODULE_NAME);
+    free_buffers();
+}
+
+module_init(encdec_init);
+module_exit(encdec_exit);
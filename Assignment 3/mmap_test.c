@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "encdec.h"
+
+//Checks mmap and ENCDEC_CMD_DECRYPT_RANGE of both devices (see "make check", it runs against the user-space
+//stand-in with its default buffer of 50 bytes). Prints what failed and exits with 1, or prints nothing.
+
+#define MEMORY_SIZE 50
+#define KEY 5
+
+static int failures = 0;
+
+static void check(int ok, int minor, const char *what) {
+    if (!ok) {
+        fprintf(stderr, "/dev/encdec%d: %s\n", minor, what);
+        failures++;
+    }
+}
+
+static unsigned char encrypt(int minor, unsigned char c) {
+    return minor == 0 ? (unsigned char) ((c + KEY) % 128) : (unsigned char) (c ^ KEY);
+}
+
+static int decrypt_range(int fd, unsigned long offset, unsigned long length) {
+    encdec_range range;
+    range.offset = offset;
+    range.length = length;
+    return ioctl(fd, ENCDEC_CMD_DECRYPT_RANGE, &range);
+}
+
+static void check_device(int minor) {
+    const char *text = "hello world";
+    size_t length = strlen(text);
+    char path[32];
+    snprintf(path, sizeof(path), "/dev/encdec%d", minor);
+    int fd = open(path, O_RDWR);
+    if (fd < 0) {
+        perror(path);
+        failures++;
+        return;
+    }
+    ioctl(fd, ENCDEC_CMD_ZERO, 0);
+    ioctl(fd, ENCDEC_CMD_CHANGE_KEY, KEY);
+
+    unsigned char *raw = mmap(NULL, MEMORY_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    unsigned char *shadow = mmap(NULL, MEMORY_SIZE, PROT_READ, MAP_SHARED, fd, ENCDEC_MMAP_SHADOW);
+    check(raw != MAP_FAILED, minor, "mmap of the buffer failed");
+    check(shadow != MAP_FAILED, minor, "mmap of the shadow failed");
+    if (raw == MAP_FAILED || shadow == MAP_FAILED) {
+        close(fd);
+        return;
+    }
+
+    //A write after the mapping shows in it, encrypted.
+    lseek(fd, 20, SEEK_SET);
+    check(write(fd, text, length) == (ssize_t) length, minor, "write failed");
+    size_t i;
+    int same = 1;
+    for (i = 0; i < length; i++) {
+        same &= raw[20 + i] == encrypt(minor, (unsigned char) text[i]);
+    }
+    check(same, minor, "the mapped buffer is not the encrypted write");
+
+    //Only the range is decrypted into the shadow.
+    check(decrypt_range(fd, 20, 5) == 0, minor, "ENCDEC_CMD_DECRYPT_RANGE failed");
+    check(memcmp(shadow + 20, "hello", 5) == 0, minor, "the shadow is not the decrypted range");
+    check(shadow[25] == 0 && shadow[19] == 0, minor, "the shadow changed outside the range");
+    check(decrypt_range(fd, 0, MEMORY_SIZE) == 0, minor, "ENCDEC_CMD_DECRYPT_RANGE of the whole buffer failed");
+    check(memcmp(shadow + 20, text, length) == 0, minor, "the shadow is not the decrypted buffer");
+
+    //Bad ranges, and ranges whose end overflows.
+    errno = 0;
+    check(decrypt_range(fd, 0, MEMORY_SIZE + 1) < 0 && errno == EINVAL, minor, "a range past the end was taken");
+    errno = 0;
+    check(decrypt_range(fd, MEMORY_SIZE + 1, 0) < 0 && errno == EINVAL, minor, "an offset past the end was taken");
+    errno = 0;
+    check(decrypt_range(fd, ~0UL, 1) < 0 && errno == EINVAL, minor, "offset ~0 was taken");
+    errno = 0;
+    check(decrypt_range(fd, 1, ~0UL) < 0 && errno == EINVAL, minor, "length ~0 was taken");
+
+    //The mappings are read only, and there is nothing at other offsets.
+    errno = 0;
+    check(mmap(NULL, MEMORY_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) == MAP_FAILED && errno == EACCES,
+          minor, "PROT_WRITE of the buffer was allowed");
+    errno = 0;
+    check(mmap(NULL, MEMORY_SIZE, PROT_WRITE, MAP_SHARED, fd, ENCDEC_MMAP_SHADOW) == MAP_FAILED && errno == EACCES,
+          minor, "PROT_WRITE of the shadow was allowed");
+    errno = 0;
+    check(mmap(NULL, MEMORY_SIZE, PROT_READ, MAP_SHARED, fd, 4096) == MAP_FAILED && errno == EINVAL, minor,
+          "mmap at an unknown offset was allowed");
+
+    //The mapping holds the shadow after the file is closed.
+    close(fd);
+    check(memcmp(shadow + 20, text, length) == 0, minor, "the shadow changed after close");
+    munmap(raw, MEMORY_SIZE);
+    munmap(shadow, MEMORY_SIZE);
+}
+
+int main() {
+    check_device(0);
+    check_device(1);
+    return failures ? 1 : 0;
+}